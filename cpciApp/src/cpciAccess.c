@@ -11,26 +11,105 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h> // Time measurement
 
 #include "cpciDefs.h"
 
+
+/* BAR mappings of the opened devices, register access falls back to ioctl() for an fd without mapping */
+#define MAX_DEVICE_MAP 4
+
+typedef struct _DEVICE_MAP
+{
+    int fd;
+    volatile char *base;
+    UINT32 size;
+} DEVICE_MAP;
+
+static DEVICE_MAP deviceMaps[MAX_DEVICE_MAP] = {
+    { ERROR, NULL, 0 }, { ERROR, NULL, 0 }, { ERROR, NULL, 0 }, { ERROR, NULL, 0 }
+};
+
+
+/* Return the mapped address of [addr, addr + length) for fd, or NULL if it is not mapped */
+static volatile char *mappedAddress(int fd, UINT32 addr, UINT32 length)
+{
+    for(int i=0; i<MAX_DEVICE_MAP; i++) {
+        if(deviceMaps[i].fd == fd) {
+            if(addr > deviceMaps[i].size || length > deviceMaps[i].size - addr) {
+                return NULL;
+            }
+            return deviceMaps[i].base + addr;
+        }
+    }
+    return NULL;
+}
+
+
+/* Copy from the mapped BAR with aligned 64-bit loads, the tail is copied with 32-bit loads */
+static void mappedCopy(char *buffer, volatile char *src, int length)
+{
+    if(((unsigned long)src & 7) == 0 && ((unsigned long)buffer & 7) == 0) {
+        for(; length >= 8; length -= 8, src += 8, buffer += 8) {
+            *(unsigned long long *)buffer = *(volatile unsigned long long *)src;
+        }
+    }
+    for(; length >= 4; length -= 4, src += 4, buffer += 4) {
+        *(UINT32 *)buffer = *(volatile UINT32 *)src;
+    }
+}
+
                            
 int openDevice(char *deviceName) 
 {
     int fd;
+    IO_DEV_INFO devInfo;
+    void *base;
+
     if((fd = open(deviceName, O_RDWR)) == ERROR)
     {
     	printf("open(): failed to open the device file %s!\n", deviceName);
+    	return fd;
     } 
+
+    /* Map the BAR so that register access does not need a system call */
+    if(ioctl(fd, RD_DEV_INFO, &devInfo) != OK) {
+        printf("openDevice(): RD_DEV_INFO is not supported by %s, use ioctl() for register access\n", deviceName);
+        return fd;
+    }
+    base = mmap(NULL, devInfo.barSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED) {
+        printf("openDevice(): mmap() of %s failed, use ioctl() for register access\n", deviceName);
+        return fd;
+    }
+    for(int i=0; i<MAX_DEVICE_MAP; i++) {
+        if(deviceMaps[i].fd == ERROR) {
+            deviceMaps[i].fd = fd;
+            deviceMaps[i].base = (volatile char *)base;
+            deviceMaps[i].size = devInfo.barSize;
+            return fd;
+        }
+    }
+    printf("openDevice(): no free device map for %s, use ioctl() for register access\n", deviceName);
+    munmap(base, devInfo.barSize);
     return fd;
 }
 
 
 int closeDevice(int fd)
 {
+    for(int i=0; i<MAX_DEVICE_MAP; i++) {
+        if(deviceMaps[i].fd == fd) {
+            munmap((void *)deviceMaps[i].base, deviceMaps[i].size);
+            deviceMaps[i].fd = ERROR;
+            deviceMaps[i].base = NULL;
+            deviceMaps[i].size = 0;
+        }
+    }
     return close(fd);
 }
 
@@ -40,6 +119,11 @@ STATUS uint8Read(int fd, UINT32 addr, UINT8 *retData)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT8));
+    if(reg != NULL) {
+        *retData = *(volatile UINT8 *)reg;
+        return OK;
+    }
     ioValue->offset = addr;
     ioctl(fd, RD_VALUE_8, ioValue);
     *retData = ioValue->value_8;
@@ -52,6 +136,11 @@ STATUS uint8Write(int fd, UINT32 addr, UINT8 data)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT8));
+    if(reg != NULL) {
+        *(volatile UINT8 *)reg = data;
+        return OK;
+    }
     ioValue->offset = addr;
     ioValue->value_8 = data;
     ioctl(fd, WR_VALUE_8, ioValue);
@@ -64,6 +153,11 @@ STATUS uint16Read(int fd, UINT32 addr, UINT16 *retData)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT16));
+    if(reg != NULL) {
+        *retData = *(volatile UINT16 *)reg;
+        return OK;
+    }
     ioValue->offset = addr;
     ioctl(fd, RD_VALUE_16, ioValue);
     *retData = ioValue->value_16;
@@ -76,6 +170,11 @@ STATUS uint16Write(int fd, UINT32 addr, UINT16 data)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT16));
+    if(reg != NULL) {
+        *(volatile UINT16 *)reg = data;
+        return OK;
+    }
     ioValue->offset = addr;
     ioValue->value_16 = data;
     ioctl(fd, WR_VALUE_16, ioValue);
@@ -88,6 +187,11 @@ STATUS uint32Read(int fd, UINT32 addr, UINT32 *retData)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT32));
+    if(reg != NULL) {
+        *retData = *(volatile UINT32 *)reg;
+        return OK;
+    }
     ioValue->offset = addr;
     ioctl(fd, RD_VALUE_32, ioValue);
     *retData = ioValue->value_32;
@@ -100,6 +204,11 @@ STATUS uint32Write(int fd, UINT32 addr, UINT32 data)
 {
     IO_VALUE _ioValue;
     IO_VALUE *ioValue = &_ioValue;
+    volatile char *reg = mappedAddress(fd, addr, sizeof(UINT32));
+    if(reg != NULL) {
+        *(volatile UINT32 *)reg = data;
+        return OK;
+    }
     ioValue->offset = addr;
     ioValue->value_32 = data;
     ioctl(fd, WR_VALUE_32, ioValue);
@@ -107,15 +216,170 @@ STATUS uint32Write(int fd, UINT32 addr, UINT32 data)
 }
 
 
-/* Waveform read, this function copy waveform data byte by byte, the speed is too slow */
-STATUS waveformReadOld(int fd, UINT32 addr, int length, char *buffer) 
+/* Register batch read or write, executed on the mapped BAR or by one ioctl per REG_BATCH_MAX entries */
+static STATUS regBatchAccess(int fd, IO_REG_ENTRY *entries, int count, int write)
+{
+    IO_REG_BATCH batch;
+    volatile char *reg;
+    int i;
+
+    for(i=0; i<count; i++) {
+        if(entries[i].width != 1 && entries[i].width != 2 && entries[i].width != 4) {
+            printf("regBatchAccess(): invalid width %d at offset 0x%08X!\n", entries[i].width, entries[i].offset);
+            return ERROR;
+        }
+    }
+
+    for(i=0; i<count; i++) {
+        reg = mappedAddress(fd, entries[i].offset, entries[i].width);
+        if(reg == NULL) break;
+        if(write) {
+            switch(entries[i].width) {
+                case 1: *(volatile UINT8 *)reg = entries[i].value; break;
+                case 2: *(volatile UINT16 *)reg = entries[i].value; break;
+                default: *(volatile UINT32 *)reg = entries[i].value; break;
+            }
+        } else {
+            switch(entries[i].width) {
+                case 1: entries[i].value = *(volatile UINT8 *)reg; break;
+                case 2: entries[i].value = *(volatile UINT16 *)reg; break;
+                default: entries[i].value = *(volatile UINT32 *)reg; break;
+            }
+        }
+    }
+    if(i == count) {
+        return OK;
+    }
+
+    /* No mapping for fd, the remaining entries go through the driver */
+    for(; i<count; i+=batch.count) {
+        batch.count = (count - i < REG_BATCH_MAX) ? count - i : REG_BATCH_MAX;
+        batch.entries = entries + i;
+        if(ioctl(fd, write ? WR_REG_BATCH : RD_REG_BATCH, &batch) != OK) {
+            printf("regBatchAccess(): ioctl() %s returns ERROR!\n", write ? "WR_REG_BATCH" : "RD_REG_BATCH");
+            return ERROR;
+        }
+    }
+    return OK;
+}
+
+
+/* Register batch read, the value of each entry is filled in */
+STATUS regBatchRead(int fd, IO_REG_ENTRY *entries, int count)
+{
+    return regBatchAccess(fd, entries, count, 0);
+}
+
+
+/* Register batch write, the value of each entry is written */
+STATUS regBatchWrite(int fd, IO_REG_ENTRY *entries, int count)
+{
+    return regBatchAccess(fd, entries, count, 1);
+}
+
+
+/* Waveform read, the whole block is copied from the mapped BAR, or transferred by a single RD_WAVEFORM ioctl */
+STATUS waveformBulkRead(int fd, UINT32 addr, int length, char *buffer) 
 {
     IO_WAVEFORM _ioWaveform;
     IO_WAVEFORM *ioWaveform = &_ioWaveform;
+    volatile char *src = mappedAddress(fd, addr, length);
+    if(src != NULL && length % 4 == 0) {
+        mappedCopy(buffer, src, length);
+        return OK;
+    }
     ioWaveform->offset = addr;
     ioWaveform->length = length;
     ioWaveform->buffer = buffer;
-    ioctl(fd, RD_WAVEFORM, ioWaveform);
+    if(ioctl(fd, RD_WAVEFORM, ioWaveform) != OK) {
+        printf("waveformBulkRead(): ioctl() RD_WAVEFORM returns ERROR!\n");
+        return ERROR;
+    }
+    return OK;
+}
+
+
+/* Device information, dmaSlotCount is 0 if the driver has no DMA support */
+STATUS deviceInfoRead(int fd, IO_DEV_INFO *devInfo)
+{
+    memset(devInfo, 0, sizeof(IO_DEV_INFO));
+    if(ioctl(fd, RD_DEV_INFO, devInfo) != OK) {
+        return ERROR;
+    }
+    return OK;
+}
+
+
+/* Start a DMA transfer of a waveform block into the next slot of the driver ring */
+STATUS waveformDmaStart(int fd, UINT32 addr, int length, UINT32 *slot)
+{
+    IO_DMA ioDma;
+    ioDma.offset = addr;
+    ioDma.length = length;
+    ioDma.buffer = NULL;
+    if(ioctl(fd, DMA_START, &ioDma) != OK) {
+        printf("waveformDmaStart(): ioctl() DMA_START returns ERROR!\n");
+        return ERROR;
+    }
+    *slot = ioDma.slot;
+    return OK;
+}
+
+
+/* Wait for the DMA transfer into slot to complete and copy the block into buffer */
+STATUS waveformDmaWait(int fd, UINT32 slot, int length, char *buffer)
+{
+    IO_DMA ioDma;
+    ioDma.offset = 0;
+    ioDma.length = length;
+    ioDma.slot = slot;
+    ioDma.buffer = buffer;
+    if(ioctl(fd, DMA_WAIT, &ioDma) != OK) {
+        printf("waveformDmaWait(): ioctl() DMA_WAIT returns ERROR!\n");
+        return ERROR;
+    }
+    return OK;
+}
+
+
+/* Waveform read, the block is pulled by the DMA engine of the board */
+STATUS waveformDmaRead(int fd, UINT32 addr, int length, char *buffer)
+{
+    UINT32 slot;
+    if(waveformDmaStart(fd, addr, length, &slot) != OK) {
+        return ERROR;
+    }
+    return waveformDmaWait(fd, slot, length, buffer);
+}
+
+
+/* Wait up to timeoutMs for a waveform ready event, returns EVENT_TIMEOUT if none was raised */
+STATUS eventWait(int fd, int timeoutMs)
+{
+    struct pollfd pfd;
+    int ret;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeoutMs);
+    if(ret < 0) {
+        printf("eventWait(): poll() returns ERROR!\n");
+        return ERROR;
+    }
+    if(ret == 0) {
+        return EVENT_TIMEOUT;
+    }
+    return OK;
+}
+
+
+/* Consume the pending waveform ready events and re-arm the interrupt, call it after the ready flag is cleared */
+STATUS eventAck(int fd, IO_EVENT *event)
+{
+    if(ioctl(fd, RD_EVENT, event) != OK) {
+        printf("eventAck(): ioctl() RD_EVENT returns ERROR!\n");
+        return ERROR;
+    }
     return OK;
 }
 
@@ -126,6 +390,11 @@ STATUS waveformRead(int fd, UINT32 addr, int length, char *buffer)
     if(length % 4 != 0) {
         return ERROR;
     }
+    volatile char *src = mappedAddress(fd, addr, length);
+    if(src != NULL) {
+        mappedCopy(buffer, src, length);
+        return OK;
+    }
     int count_of_4bytes = length / 4;
 	for(int i=0; i<count_of_4bytes; i++) {
 	    if(uint32Read(fd, addr + i * 4, (UINT32 *)buffer + i) != OK) {
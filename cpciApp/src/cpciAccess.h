@@ -31,7 +31,25 @@ STATUS uint32Read(int fd, UINT32 addr, UINT32 *retData);
 
 STATUS uint32Write(int fd, UINT32 addr, UINT32 data);
 
+STATUS regBatchRead(int fd, IO_REG_ENTRY *entries, int count);
+
+STATUS regBatchWrite(int fd, IO_REG_ENTRY *entries, int count);
+
 STATUS waveformRead(int fd, UINT32 addr, int length, char *buffer);
 
+STATUS waveformBulkRead(int fd, UINT32 addr, int length, char *buffer);
+
+STATUS deviceInfoRead(int fd, IO_DEV_INFO *devInfo);
+
+STATUS waveformDmaStart(int fd, UINT32 addr, int length, UINT32 *slot);
+
+STATUS waveformDmaWait(int fd, UINT32 slot, int length, char *buffer);
+
+STATUS waveformDmaRead(int fd, UINT32 addr, int length, char *buffer);
+
+STATUS eventWait(int fd, int timeoutMs);
+
+STATUS eventAck(int fd, IO_EVENT *event);
+
 
 #endif
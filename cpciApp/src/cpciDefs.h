@@ -25,6 +25,7 @@ typedef int INT32;
 
 #define OK 0
 #define ERROR -1
+#define EVENT_TIMEOUT 1    /* Returned by eventWait() when no event was raised */
 
 
 /**
@@ -45,6 +46,44 @@ typedef struct _IO_WAVEFORM
     char *buffer;
 } IO_WAVEFORM;
 
+typedef struct _IO_DEV_INFO
+{
+    UINT32 barSize;         /* Size of the register BAR, which is also the length accepted by mmap() */
+    UINT32 dmaSlotCount;    /* Number of slots in the DMA ring, 0 if DMA is not supported */
+    UINT32 dmaSlotSize;     /* Maximum length of one DMA transfer */
+    UINT32 mock;            /* 1 if the board is emulated by the driver */
+    UINT32 irq;             /* 1 if waveform ready events are delivered by interrupt, see RD_EVENT */
+} IO_DEV_INFO;
+
+typedef struct _IO_EVENT
+{
+    UINT32 count;     /* Waveform ready events since the driver was loaded */
+    UINT32 missed;    /* Events raised since the last RD_EVENT on this file, minus one */
+} IO_EVENT;
+
+typedef struct _IO_DMA
+{
+    UINT32 offset;    /* DMA_START: BAR offset of the block */
+    UINT32 length;    /* DMA_START: length of the block, DMA_WAIT: size of buffer */
+    UINT32 slot;      /* Returned by DMA_START, passed to DMA_WAIT */
+    char *buffer;     /* DMA_WAIT: the slot is copied here once the transfer completes */
+} IO_DMA;
+
+typedef struct _IO_REG_ENTRY
+{
+    UINT32 offset;
+    UINT32 width;    /* Access width in bytes: 1, 2 or 4 */
+    UINT32 value;
+} IO_REG_ENTRY;
+
+typedef struct _IO_REG_BATCH
+{
+    UINT32 count;    /* Number of entries, at most REG_BATCH_MAX */
+    IO_REG_ENTRY *entries;
+} IO_REG_BATCH;
+
+#define REG_BATCH_MAX 256
+
 
 #define RD_VALUE_8   _IOR('a', 'a', IO_VALUE *)
 #define WR_VALUE_8   _IOW('a', 'b', IO_VALUE *)
@@ -57,5 +96,15 @@ typedef struct _IO_WAVEFORM
 
 #define RD_WAVEFORM  _IOR('a', 'g', IO_WAVEFORM *)
 
+#define RD_DEV_INFO  _IOR('a', 'h', IO_DEV_INFO *)
+
+#define RD_REG_BATCH _IOR('a', 'i', IO_REG_BATCH *)
+#define WR_REG_BATCH _IOW('a', 'j', IO_REG_BATCH *)
+
+#define DMA_START    _IOWR('a', 'k', IO_DMA *)
+#define DMA_WAIT     _IOWR('a', 'l', IO_DMA *)
+
+#define RD_EVENT     _IOR('a', 'm', IO_EVENT *)
+
 
 #endif
@@ -0,0 +1,765 @@
+/**
+ * cpciDsp.c -- Conversion of the raw LLRF waveforms into EPICS waveforms
+ *
+ *        The I/Q of both RF chains are converted block by block into amplitude, phase, power,
+ *        VSWR and the cavity power sums. Amplitude, power, VSWR and the sums are computed with
+ *        AVX2 or SSE2 when the CPU supports it, selected once at load time. The vector and the
+ *        scalar kernels perform the same IEEE operations in the same order, so their results
+ *        are identical.
+ *
+ *        Phase is computed by libm atan2() in DSP_PHASE_ACCURATE mode. In DSP_PHASE_FAST mode
+ *        atan2() is replaced by a degree 11 minimax polynomial of atan() on [0, 1] with octant
+ *        reduction, also vectorized. Its maximum error over the whole int16 I/Q domain is
+ *        1.7e-6 rad, that is 0.0001 degree.
+ *
+ *        The multi-frame averaging of the raw waveforms accumulates int16 into int32 sums for the
+ *        boxcar and updates a float accumulator for the exponential average, 16 points at a time
+ *        with AVX2. The averages are rounded back to int16 for the conversion.
+ *
+ * Author: Lin Wang (CSNS)
+ * Email:  wanglin@ihep.ac.cn
+ * Date:   November 14, 2022
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86
+#include <immintrin.h>
+#endif
+
+#include "cpciDsp.h"
+
+
+/* Points per block, the phase and the sums of a block are computed while the block is in cache */
+#define DSP_BLOCK 256
+
+
+typedef void (*DSP_CHAIN_FUNC)(const DSP_RF_CHAIN *chain, int start, int end);
+typedef void (*DSP_SUM_FUNC)(const DSP_FRAME *frame, int start, int end);
+typedef void (*DSP_PHASE_FUNC)(const short *inI, const short *inQ, double scale, double *out, int start, int end);
+typedef void (*DSP_ACCUMULATE_FUNC)(const short *in, int *sum, int count);
+typedef void (*DSP_AVERAGE_FUNC)(const int *sum, float frames, short *out, int count);
+typedef void (*DSP_EMA_FUNC)(const short *in, float alpha, float *acc, int count);
+typedef void (*DSP_ROUND_FUNC)(const float *in, short *out, int count);
+
+
+/* Minimax coefficients of atan(a) / a in a^2, a in [0, 1] */
+#define ATAN_C0  0.99997726
+#define ATAN_C1 -0.33262347
+#define ATAN_C2  0.19354346
+#define ATAN_C3 -0.11643287
+#define ATAN_C4  0.05265332
+#define ATAN_C5 -0.01172120
+
+#define DSP_PI_2 1.57079632679489661923
+#define DSP_PI   3.14159265358979323846
+
+
+/* Amplitude, power and VSWR of one chain, sqrt(power) is taken as amplitude * sqrt(scale) */
+static void chainScalar(const DSP_RF_CHAIN *chain, int start, int end)
+{
+    const double fwdRoot = sqrt(chain->fwdScale);
+    const double rflRoot = sqrt(chain->rflScale);
+    double fi, fq, ri, rq, fm, rm, fa, ra, fv, rv;
+    int i;
+
+    for(i = start; i < end; i++) {
+        fi = chain->fwdI[i];
+        fq = chain->fwdQ[i];
+        ri = chain->rflI[i];
+        rq = chain->rflQ[i];
+
+        fm = fi * fi + fq * fq;
+        rm = ri * ri + rq * rq;
+        fa = sqrt(fm);
+        ra = sqrt(rm);
+
+        chain->fwdAmp[i] = fa;
+        chain->rflAmp[i] = ra;
+        chain->fwdPower[i] = fm * chain->fwdScale;
+        chain->rflPower[i] = rm * chain->rflScale;
+
+        fv = fa * fwdRoot;
+        rv = ra * rflRoot;
+        chain->vswr[i] = (fv + rv) / (fv - rv);
+    }
+}
+
+
+/* Cavity power sums of both chains */
+static void sumScalar(const DSP_FRAME *frame, int start, int end)
+{
+    const DSP_RF_CHAIN *c1 = &frame->chain[0];
+    const DSP_RF_CHAIN *c2 = &frame->chain[1];
+    double fwd, rfl;
+    int i;
+
+    for(i = start; i < end; i++) {
+        fwd = c1->fwdPower[i] + c2->fwdPower[i];
+        rfl = c1->rflPower[i] + c2->rflPower[i];
+        frame->inPower[i] = fwd - rfl;
+        frame->fwdPower[i] = fwd;
+        frame->rflPower[i] = rfl;
+    }
+}
+
+
+/* Phase in degrees, libm has no vector atan2 */
+static void phaseScalar(const short *inI, const short *inQ, double scale, double *out, int start, int end)
+{
+    int i;
+
+    for(i = start; i < end; i++) {
+        out[i] = atan2((double)inQ[i], (double)inI[i]) * scale;
+    }
+}
+
+
+/* Phase in degrees with the polynomial atan2 */
+static void phaseFastScalar(const short *inI, const short *inQ, double scale, double *out, int start, int end)
+{
+    double x, y, ax, ay, mx, mn, a, s, r;
+    int i;
+
+    for(i = start; i < end; i++) {
+        x = inI[i];
+        y = inQ[i];
+        ax = fabs(x);
+        ay = fabs(y);
+        mx = (ax > ay) ? ax : ay;
+        mn = (ax > ay) ? ay : ax;
+
+        /* Both zero gives 0 as atan2(0, 0), otherwise mx >= 1 */
+        a = mn / ((mx < 1.0) ? 1.0 : mx);
+        s = a * a;
+        r = a * (ATAN_C0 + s * (ATAN_C1 + s * (ATAN_C2 + s * (ATAN_C3 + s * (ATAN_C4 + s * ATAN_C5)))));
+
+        if(ay > ax) r = DSP_PI_2 - r;
+        if(x < 0) r = DSP_PI - r;
+        if(y < 0) r = -r;
+        out[i] = r * scale;
+    }
+}
+
+
+/* Boxcar sum of the frames */
+static void accumulateScalar(const short *in, int *sum, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        sum[i] += in[i];
+    }
+}
+
+
+/* Boxcar average, rounded to nearest even like the vector conversion.
+ * The sums are exact in float and the division is rounded once, so the vector average is the same */
+static void averageScalar(const int *sum, float frames, short *out, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        out[i] = (short)lrintf((float)sum[i] / frames);
+    }
+}
+
+
+/* Exponential average, acc += alpha * (in - acc) */
+static void emaScalar(const short *in, float alpha, float *acc, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        acc[i] = acc[i] + alpha * ((float)in[i] - acc[i]);
+    }
+}
+
+
+static void roundScalar(const float *in, short *out, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        out[i] = (short)lrintf(in[i]);
+    }
+}
+
+
+#ifdef DSP_X86
+
+/* 4 int16 points to 4 doubles */
+#define AVX2_LOAD(p) _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+
+__attribute__((target("avx2")))
+static void chainAvx2(const DSP_RF_CHAIN *chain, int start, int end)
+{
+    const __m256d fwdScale = _mm256_set1_pd(chain->fwdScale);
+    const __m256d rflScale = _mm256_set1_pd(chain->rflScale);
+    const __m256d fwdRoot = _mm256_set1_pd(sqrt(chain->fwdScale));
+    const __m256d rflRoot = _mm256_set1_pd(sqrt(chain->rflScale));
+    __m256d fi, fq, ri, rq, fm, rm, fa, ra, fv, rv;
+    int i;
+
+    for(i = start; i + 4 <= end; i += 4) {
+        fi = AVX2_LOAD(chain->fwdI + i);
+        fq = AVX2_LOAD(chain->fwdQ + i);
+        ri = AVX2_LOAD(chain->rflI + i);
+        rq = AVX2_LOAD(chain->rflQ + i);
+
+        fm = _mm256_add_pd(_mm256_mul_pd(fi, fi), _mm256_mul_pd(fq, fq));
+        rm = _mm256_add_pd(_mm256_mul_pd(ri, ri), _mm256_mul_pd(rq, rq));
+        fa = _mm256_sqrt_pd(fm);
+        ra = _mm256_sqrt_pd(rm);
+
+        _mm256_storeu_pd(chain->fwdAmp + i, fa);
+        _mm256_storeu_pd(chain->rflAmp + i, ra);
+        _mm256_storeu_pd(chain->fwdPower + i, _mm256_mul_pd(fm, fwdScale));
+        _mm256_storeu_pd(chain->rflPower + i, _mm256_mul_pd(rm, rflScale));
+
+        fv = _mm256_mul_pd(fa, fwdRoot);
+        rv = _mm256_mul_pd(ra, rflRoot);
+        _mm256_storeu_pd(chain->vswr + i, _mm256_div_pd(_mm256_add_pd(fv, rv), _mm256_sub_pd(fv, rv)));
+    }
+    chainScalar(chain, i, end);
+}
+
+
+__attribute__((target("avx2")))
+static void sumAvx2(const DSP_FRAME *frame, int start, int end)
+{
+    const DSP_RF_CHAIN *c1 = &frame->chain[0];
+    const DSP_RF_CHAIN *c2 = &frame->chain[1];
+    __m256d fwd, rfl;
+    int i;
+
+    for(i = start; i + 4 <= end; i += 4) {
+        fwd = _mm256_add_pd(_mm256_loadu_pd(c1->fwdPower + i), _mm256_loadu_pd(c2->fwdPower + i));
+        rfl = _mm256_add_pd(_mm256_loadu_pd(c1->rflPower + i), _mm256_loadu_pd(c2->rflPower + i));
+        _mm256_storeu_pd(frame->inPower + i, _mm256_sub_pd(fwd, rfl));
+        _mm256_storeu_pd(frame->fwdPower + i, fwd);
+        _mm256_storeu_pd(frame->rflPower + i, rfl);
+    }
+    sumScalar(frame, i, end);
+}
+
+
+__attribute__((target("avx2")))
+static void phaseFastAvx2(const short *inI, const short *inQ, double scale, double *out, int start, int end)
+{
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d halfPi = _mm256_set1_pd(DSP_PI_2);
+    const __m256d pi = _mm256_set1_pd(DSP_PI);
+    const __m256d vScale = _mm256_set1_pd(scale);
+    __m256d x, y, ax, ay, mx, mn, a, s, r;
+    int i;
+
+    for(i = start; i + 4 <= end; i += 4) {
+        x = AVX2_LOAD(inI + i);
+        y = AVX2_LOAD(inQ + i);
+        ax = _mm256_andnot_pd(signMask, x);
+        ay = _mm256_andnot_pd(signMask, y);
+        mx = _mm256_max_pd(_mm256_max_pd(ax, ay), one);
+        mn = _mm256_min_pd(ax, ay);
+
+        a = _mm256_div_pd(mn, mx);
+        s = _mm256_mul_pd(a, a);
+        r = _mm256_add_pd(_mm256_set1_pd(ATAN_C4), _mm256_mul_pd(s, _mm256_set1_pd(ATAN_C5)));
+        r = _mm256_add_pd(_mm256_set1_pd(ATAN_C3), _mm256_mul_pd(s, r));
+        r = _mm256_add_pd(_mm256_set1_pd(ATAN_C2), _mm256_mul_pd(s, r));
+        r = _mm256_add_pd(_mm256_set1_pd(ATAN_C1), _mm256_mul_pd(s, r));
+        r = _mm256_add_pd(_mm256_set1_pd(ATAN_C0), _mm256_mul_pd(s, r));
+        r = _mm256_mul_pd(a, r);
+
+        r = _mm256_blendv_pd(r, _mm256_sub_pd(halfPi, r), _mm256_cmp_pd(ay, ax, _CMP_GT_OQ));
+        r = _mm256_blendv_pd(r, _mm256_sub_pd(pi, r), x);
+        r = _mm256_xor_pd(r, _mm256_and_pd(y, signMask));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(r, vScale));
+    }
+    phaseFastScalar(inI, inQ, scale, out, i, end);
+}
+
+
+/* 16 int16 points to 2 x 8 int32 */
+#define AVX2_LOAD16_LOW(x)  _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x))
+#define AVX2_LOAD16_HIGH(x) _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1))
+
+/* 2 x 8 int32 to 16 int16 in order, packs works within each 128-bit lane */
+#define AVX2_PACK16(lo, hi) _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0))
+
+__attribute__((target("avx2")))
+static void accumulateAvx2(const short *in, int *sum, int count)
+{
+    __m256i x;
+    int i;
+
+    for(i = 0; i + 16 <= count; i += 16) {
+        x = _mm256_loadu_si256((const __m256i *)(in + i));
+        _mm256_storeu_si256((__m256i *)(sum + i),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sum + i)), AVX2_LOAD16_LOW(x)));
+        _mm256_storeu_si256((__m256i *)(sum + i + 8),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sum + i + 8)), AVX2_LOAD16_HIGH(x)));
+    }
+    for(; i < count; i++) {
+        sum[i] += in[i];
+    }
+}
+
+
+__attribute__((target("avx2")))
+static void averageAvx2(const int *sum, float frames, short *out, int count)
+{
+    const __m256 vFrames = _mm256_set1_ps(frames);
+    __m256i lo, hi;
+    int i;
+
+    for(i = 0; i + 16 <= count; i += 16) {
+        lo = _mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(sum + i))), vFrames));
+        hi = _mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(sum + i + 8))), vFrames));
+        _mm256_storeu_si256((__m256i *)(out + i), AVX2_PACK16(lo, hi));
+    }
+    averageScalar(sum + i, frames, out + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void emaAvx2(const short *in, float alpha, float *acc, int count)
+{
+    const __m256 vAlpha = _mm256_set1_ps(alpha);
+    __m256i x;
+    __m256 a;
+    int i;
+
+    for(i = 0; i + 16 <= count; i += 16) {
+        x = _mm256_loadu_si256((const __m256i *)(in + i));
+        a = _mm256_loadu_ps(acc + i);
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(a, _mm256_mul_ps(vAlpha, _mm256_sub_ps(_mm256_cvtepi32_ps(AVX2_LOAD16_LOW(x)), a))));
+        a = _mm256_loadu_ps(acc + i + 8);
+        _mm256_storeu_ps(acc + i + 8, _mm256_add_ps(a, _mm256_mul_ps(vAlpha, _mm256_sub_ps(_mm256_cvtepi32_ps(AVX2_LOAD16_HIGH(x)), a))));
+    }
+    emaScalar(in + i, alpha, acc + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void roundAvx2(const float *in, short *out, int count)
+{
+    int i;
+
+    for(i = 0; i + 16 <= count; i += 16) {
+        _mm256_storeu_si256((__m256i *)(out + i), AVX2_PACK16(_mm256_cvtps_epi32(_mm256_loadu_ps(in + i)),
+                                                              _mm256_cvtps_epi32(_mm256_loadu_ps(in + i + 8))));
+    }
+    roundScalar(in + i, out + i, count - i);
+}
+
+
+/* 4 int16 points to 4 int32, SSE2 has no sign extension instruction */
+#define SSE2_LOAD(p) _mm_srai_epi32(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(p)), _mm_loadl_epi64((const __m128i *)(p))), 16)
+#define SSE2_LOW(x)  _mm_cvtepi32_pd(x)
+#define SSE2_HIGH(x) _mm_cvtepi32_pd(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)))
+
+__attribute__((target("sse2")))
+static inline void chainSse2Step(const DSP_RF_CHAIN *chain, int i, __m128d fi, __m128d fq, __m128d ri, __m128d rq,
+                                 __m128d fwdScale, __m128d rflScale, __m128d fwdRoot, __m128d rflRoot)
+{
+    __m128d fm, rm, fa, ra, fv, rv;
+
+    fm = _mm_add_pd(_mm_mul_pd(fi, fi), _mm_mul_pd(fq, fq));
+    rm = _mm_add_pd(_mm_mul_pd(ri, ri), _mm_mul_pd(rq, rq));
+    fa = _mm_sqrt_pd(fm);
+    ra = _mm_sqrt_pd(rm);
+
+    _mm_storeu_pd(chain->fwdAmp + i, fa);
+    _mm_storeu_pd(chain->rflAmp + i, ra);
+    _mm_storeu_pd(chain->fwdPower + i, _mm_mul_pd(fm, fwdScale));
+    _mm_storeu_pd(chain->rflPower + i, _mm_mul_pd(rm, rflScale));
+
+    fv = _mm_mul_pd(fa, fwdRoot);
+    rv = _mm_mul_pd(ra, rflRoot);
+    _mm_storeu_pd(chain->vswr + i, _mm_div_pd(_mm_add_pd(fv, rv), _mm_sub_pd(fv, rv)));
+}
+
+
+__attribute__((target("sse2")))
+static void chainSse2(const DSP_RF_CHAIN *chain, int start, int end)
+{
+    const __m128d fwdScale = _mm_set1_pd(chain->fwdScale);
+    const __m128d rflScale = _mm_set1_pd(chain->rflScale);
+    const __m128d fwdRoot = _mm_set1_pd(sqrt(chain->fwdScale));
+    const __m128d rflRoot = _mm_set1_pd(sqrt(chain->rflScale));
+    __m128i fi, fq, ri, rq;
+    int i;
+
+    for(i = start; i + 4 <= end; i += 4) {
+        fi = SSE2_LOAD(chain->fwdI + i);
+        fq = SSE2_LOAD(chain->fwdQ + i);
+        ri = SSE2_LOAD(chain->rflI + i);
+        rq = SSE2_LOAD(chain->rflQ + i);
+
+        chainSse2Step(chain, i, SSE2_LOW(fi), SSE2_LOW(fq), SSE2_LOW(ri), SSE2_LOW(rq),
+                      fwdScale, rflScale, fwdRoot, rflRoot);
+        chainSse2Step(chain, i + 2, SSE2_HIGH(fi), SSE2_HIGH(fq), SSE2_HIGH(ri), SSE2_HIGH(rq),
+                      fwdScale, rflScale, fwdRoot, rflRoot);
+    }
+    chainScalar(chain, i, end);
+}
+
+
+__attribute__((target("sse2")))
+static void sumSse2(const DSP_FRAME *frame, int start, int end)
+{
+    const DSP_RF_CHAIN *c1 = &frame->chain[0];
+    const DSP_RF_CHAIN *c2 = &frame->chain[1];
+    __m128d fwd, rfl;
+    int i;
+
+    for(i = start; i + 2 <= end; i += 2) {
+        fwd = _mm_add_pd(_mm_loadu_pd(c1->fwdPower + i), _mm_loadu_pd(c2->fwdPower + i));
+        rfl = _mm_add_pd(_mm_loadu_pd(c1->rflPower + i), _mm_loadu_pd(c2->rflPower + i));
+        _mm_storeu_pd(frame->inPower + i, _mm_sub_pd(fwd, rfl));
+        _mm_storeu_pd(frame->fwdPower + i, fwd);
+        _mm_storeu_pd(frame->rflPower + i, rfl);
+    }
+    sumScalar(frame, i, end);
+}
+
+
+
+__attribute__((target("sse2")))
+static inline __m128d phaseFastSse2Step(__m128d x, __m128d y, __m128d scale)
+{
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    __m128d ax, ay, mx, mn, a, s, r, mask;
+
+    ax = _mm_andnot_pd(signMask, x);
+    ay = _mm_andnot_pd(signMask, y);
+    mx = _mm_max_pd(_mm_max_pd(ax, ay), _mm_set1_pd(1.0));
+    mn = _mm_min_pd(ax, ay);
+
+    a = _mm_div_pd(mn, mx);
+    s = _mm_mul_pd(a, a);
+    r = _mm_add_pd(_mm_set1_pd(ATAN_C4), _mm_mul_pd(s, _mm_set1_pd(ATAN_C5)));
+    r = _mm_add_pd(_mm_set1_pd(ATAN_C3), _mm_mul_pd(s, r));
+    r = _mm_add_pd(_mm_set1_pd(ATAN_C2), _mm_mul_pd(s, r));
+    r = _mm_add_pd(_mm_set1_pd(ATAN_C1), _mm_mul_pd(s, r));
+    r = _mm_add_pd(_mm_set1_pd(ATAN_C0), _mm_mul_pd(s, r));
+    r = _mm_mul_pd(a, r);
+
+    /* SSE2 has no blend, select with and/andnot/or */
+    mask = _mm_cmpgt_pd(ay, ax);
+    r = _mm_or_pd(_mm_and_pd(mask, _mm_sub_pd(_mm_set1_pd(DSP_PI_2), r)), _mm_andnot_pd(mask, r));
+    mask = _mm_cmplt_pd(x, _mm_setzero_pd());
+    r = _mm_or_pd(_mm_and_pd(mask, _mm_sub_pd(_mm_set1_pd(DSP_PI), r)), _mm_andnot_pd(mask, r));
+    r = _mm_xor_pd(r, _mm_and_pd(y, signMask));
+    return _mm_mul_pd(r, scale);
+}
+
+
+__attribute__((target("sse2")))
+static void phaseFastSse2(const short *inI, const short *inQ, double scale, double *out, int start, int end)
+{
+    const __m128d vScale = _mm_set1_pd(scale);
+    __m128i x, y;
+    int i;
+
+    for(i = start; i + 4 <= end; i += 4) {
+        x = SSE2_LOAD(inI + i);
+        y = SSE2_LOAD(inQ + i);
+        _mm_storeu_pd(out + i, phaseFastSse2Step(SSE2_LOW(x), SSE2_LOW(y), vScale));
+        _mm_storeu_pd(out + i + 2, phaseFastSse2Step(SSE2_HIGH(x), SSE2_HIGH(y), vScale));
+    }
+    phaseFastScalar(inI, inQ, scale, out, i, end);
+}
+
+#endif
+
+
+/* Kernels selected for this CPU */
+static DSP_CHAIN_FUNC chainFunc = chainScalar;
+static DSP_SUM_FUNC sumFunc = sumScalar;
+static DSP_PHASE_FUNC phaseFastFunc = phaseFastScalar;
+static DSP_ACCUMULATE_FUNC accumulateFunc = accumulateScalar;
+static DSP_AVERAGE_FUNC averageFunc = averageScalar;
+static DSP_EMA_FUNC emaFunc = emaScalar;
+static DSP_ROUND_FUNC roundFunc = roundScalar;
+static const char *engineName = "scalar";
+
+
+#ifdef DSP_X86
+/* Select the kernels before any thread of the IOC is running */
+__attribute__((constructor))
+static void dspSelectEngine(void)
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        chainFunc = chainAvx2;
+        sumFunc = sumAvx2;
+        phaseFastFunc = phaseFastAvx2;
+        accumulateFunc = accumulateAvx2;
+        averageFunc = averageAvx2;
+        emaFunc = emaAvx2;
+        roundFunc = roundAvx2;
+        engineName = "avx2";
+    } else if(__builtin_cpu_supports("sse2")) {
+        chainFunc = chainSse2;
+        sumFunc = sumSse2;
+        phaseFastFunc = phaseFastSse2;
+        engineName = "sse2";
+    }
+}
+#endif
+
+
+void dspConvertFrame(const DSP_FRAME *frame, int start, int end)
+{
+    const DSP_RF_CHAIN *chain;
+    DSP_PHASE_FUNC phaseFunc = (frame->phaseMode == DSP_PHASE_FAST) ? phaseFastFunc : phaseScalar;
+    int blockStart, blockEnd;
+    int c;
+
+    for(blockStart = start; blockStart < end; blockStart = blockEnd) {
+        blockEnd = (end - blockStart > DSP_BLOCK) ? blockStart + DSP_BLOCK : end;
+
+        for(c = 0; c < 2; c++) {
+            chain = &frame->chain[c];
+            if((chain->outputs & DSP_CHAIN_MAGNITUDE) || frame->sums) {
+                chainFunc(chain, blockStart, blockEnd);
+            }
+            if(chain->outputs & DSP_CHAIN_FWD_PHASE) {
+                phaseFunc(chain->fwdI, chain->fwdQ, frame->phaseScale, chain->fwdPhase, blockStart, blockEnd);
+            }
+            if(chain->outputs & DSP_CHAIN_RFL_PHASE) {
+                phaseFunc(chain->rflI, chain->rflQ, frame->phaseScale, chain->rflPhase, blockStart, blockEnd);
+            }
+        }
+        if(frame->sums) {
+            sumFunc(frame, blockStart, blockEnd);
+        }
+    }
+}
+
+
+void dspScale(const short *in, double scale, double *out, int start, int end)
+{
+    int i;
+
+    for(i = start; i < end; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+
+void dspNarrow(const double *in, float *out, int start, int end)
+{
+    int i;
+
+    for(i = start; i < end; i++) {
+        out[i] = (float)in[i];
+    }
+}
+
+
+int dspMinMax(const double *in, int length, int factor, double *out)
+{
+    int i, j, end, iMin, iMax;
+    int count = 0;
+
+    for(i = 0; i < length; i += factor) {
+        end = (i + factor < length) ? i + factor : length;
+        iMin = iMax = i;
+        for(j = i + 1; j < end; j++) {
+            if(in[j] < in[iMin]) iMin = j;
+            if(in[j] > in[iMax]) iMax = j;
+        }
+        /* Keep the time order so that a spike is drawn where it happened */
+        if(iMin <= iMax) {
+            out[count++] = in[iMin];
+            out[count++] = in[iMax];
+        } else {
+            out[count++] = in[iMax];
+            out[count++] = in[iMin];
+        }
+    }
+    return count;
+}
+
+
+void dspAccumulate(const short *in, int *sum, int count)
+{
+    accumulateFunc(in, sum, count);
+}
+
+
+void dspAverage(const int *sum, int frames, short *out, int count)
+{
+    averageFunc(sum, (float)frames, out, count);
+}
+
+
+void dspEma(const short *in, float alpha, float *acc, int count)
+{
+    emaFunc(in, alpha, acc, count);
+}
+
+
+void dspRound(const float *in, short *out, int count)
+{
+    roundFunc(in, out, count);
+}
+
+
+void dspStatsReset(DSP_STATS *stats)
+{
+    stats->count = 0;
+    stats->min = 0;
+    stats->max = 0;
+    stats->sum = 0;
+    stats->sumSquare = 0;
+    stats->sumSin = 0;
+    stats->sumCos = 0;
+}
+
+
+void dspStatsAdd(DSP_STATS *stats, const double *in, int start, int end, int circular)
+{
+    double mn, mx, sum = 0, sumSquare = 0, sumSin = 0, sumCos = 0;
+    int i;
+
+    if(start >= end) return;
+
+    mn = mx = in[start];
+    for(i = start; i < end; i++) {
+        if(in[i] < mn) mn = in[i];
+        if(in[i] > mx) mx = in[i];
+        sum += in[i];
+        sumSquare += in[i] * in[i];
+    }
+    if(circular) {
+        for(i = start; i < end; i++) {
+            sumSin += sin(in[i] * (DSP_PI / 180));
+            sumCos += cos(in[i] * (DSP_PI / 180));
+        }
+    }
+
+    if(stats->count == 0 || mn < stats->min) stats->min = mn;
+    if(stats->count == 0 || mx > stats->max) stats->max = mx;
+    stats->count += end - start;
+    stats->sum += sum;
+    stats->sumSquare += sumSquare;
+    stats->sumSin += sumSin;
+    stats->sumCos += sumCos;
+}
+
+
+void dspStatsMerge(DSP_STATS *stats, const DSP_STATS *other)
+{
+    if(other->count == 0) return;
+
+    if(stats->count == 0 || other->min < stats->min) stats->min = other->min;
+    if(stats->count == 0 || other->max > stats->max) stats->max = other->max;
+    stats->count += other->count;
+    stats->sum += other->sum;
+    stats->sumSquare += other->sumSquare;
+    stats->sumSin += other->sumSin;
+    stats->sumCos += other->sumCos;
+}
+
+
+double dspStatsMean(const DSP_STATS *stats, int circular)
+{
+    if(stats->count == 0) return 0;
+    if(circular) return atan2(stats->sumSin, stats->sumCos) * (180 / DSP_PI);
+    return stats->sum / stats->count;
+}
+
+
+double dspStatsRms(const DSP_STATS *stats)
+{
+    if(stats->count == 0) return 0;
+    return sqrt(stats->sumSquare / stats->count);
+}
+
+
+void dspStabilityReset(DSP_STABILITY *stability, int window)
+{
+    stability->window = window;
+    stability->count = 0;
+    stability->next = 0;
+    stability->mean = 0;
+    stability->m2 = 0;
+}
+
+
+void dspStabilityAdd(DSP_STABILITY *stability, double value, int circular)
+{
+    double delta;
+    double oldest;
+    double oldMean = stability->mean;
+
+    if(circular && stability->count > 0) {
+        value = oldMean + remainder(value - oldMean, 360);
+    }
+
+    if(stability->window == 0 || stability->count < stability->window) {
+        /* Welford update */
+        stability->count++;
+        delta = value - oldMean;
+        stability->mean += delta / stability->count;
+        stability->m2 += delta * (value - stability->mean);
+        if(stability->window > 0) {
+            stability->history[stability->next] = value;
+            stability->next = (stability->next + 1) % stability->window;
+        }
+        return;
+    }
+
+    /* Full window: the value replaces the oldest one */
+    oldest = stability->history[stability->next];
+    if(circular) {
+        oldest = oldMean + remainder(oldest - oldMean, 360);
+    }
+    delta = value - oldest;
+    stability->mean += delta / stability->window;
+    stability->m2 += delta * (value - stability->mean + oldest - oldMean);
+    if(stability->m2 < 0) stability->m2 = 0;
+    stability->history[stability->next] = value;
+    stability->next = (stability->next + 1) % stability->window;
+}
+
+
+double dspStabilityStd(const DSP_STABILITY *stability)
+{
+    if(stability->count < 2) return 0;
+    return sqrt(stability->m2 / (stability->count - 1));
+}
+
+
+unsigned long long dspHash(const short *in, int count)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    unsigned long long word;
+    int i;
+
+    /* FNV-1a on 64-bit words, 4 points at a time. The multiplication only carries a difference upward,
+     * the xorshift folds the high bits back so that changes of the same high bit in two words do not cancel */
+    for(i = 0; i + 4 <= count; i += 4) {
+        memcpy(&word, in + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 32;
+    }
+    for(; i < count; i++) {
+        hash = (hash ^ (unsigned short)in[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+
+const char *dspEngineName(void)
+{
+    return engineName;
+}
@@ -0,0 +1,142 @@
+/**
+ * cpciDsp.h -- Conversion of the raw LLRF waveforms into EPICS waveforms
+ *
+ * Author: Lin Wang (CSNS)
+ * Email:  wanglin@ihep.ac.cn
+ * Date:   November 14, 2022
+ *
+ */
+#ifndef CPCI_DSP_H
+#define CPCI_DSP_H
+
+
+/* Phase computation, see cpciDsp.c for the error of DSP_PHASE_FAST */
+#define DSP_PHASE_ACCURATE 0    /* libm atan2() */
+#define DSP_PHASE_FAST     1    /* Polynomial atan2(), error below 0.0001 degree */
+
+
+/* Outputs of one RF chain, the others are left as they are */
+#define DSP_CHAIN_MAGNITUDE 0x1    /* Amplitudes, powers and VSWR, one fused kernel */
+#define DSP_CHAIN_FWD_PHASE 0x2
+#define DSP_CHAIN_RFL_PHASE 0x4
+#define DSP_CHAIN_ALL       0x7
+
+
+/* One RF chain: forward and reflected I/Q of one power amplifier */
+typedef struct _DSP_RF_CHAIN
+{
+    const short *fwdI;
+    const short *fwdQ;
+    const short *rflI;
+    const short *rflQ;
+
+    double fwdScale;    /* power = (I^2 + Q^2) * scale, that is k * 10^(b/10) / 1000 */
+    double rflScale;
+
+    double *fwdAmp;
+    double *fwdPhase;
+    double *fwdPower;
+    double *rflAmp;
+    double *rflPhase;
+    double *rflPower;
+    double *vswr;
+
+    int outputs;    /* DSP_CHAIN_* bits of the outputs to compute */
+} DSP_RF_CHAIN;
+
+/* Two RF chains feeding one cavity */
+typedef struct _DSP_FRAME
+{
+    DSP_RF_CHAIN chain[2];
+    double phaseScale;    /* Degrees per radian */
+    int phaseMode;        /* DSP_PHASE_ACCURATE or DSP_PHASE_FAST */
+
+    double *inPower;      /* Forward power minus reflected power of both chains */
+    double *fwdPower;
+    double *rflPower;
+
+    int sums;             /* Compute the cavity sums, the powers of both chains are computed for them */
+} DSP_FRAME;
+
+
+/* Statistics of one waveform over a window, accumulated block by block */
+typedef struct _DSP_STATS
+{
+    int count;
+    double min;
+    double max;
+    double sum;
+    double sumSquare;
+    double sumSin;    /* Phases in degrees, for the circular mean */
+    double sumCos;
+} DSP_STATS;
+
+
+/* Running mean and variance of one value per pulse, over all the pulses or the last window pulses */
+typedef struct _DSP_STABILITY
+{
+    int window;         /* Pulses in the window, 0 for all the pulses since the reset */
+    double *history;    /* Values of the window, window entries */
+    int count;
+    int next;           /* Entry of history replaced by the next value once the window is full */
+    double mean;
+    double m2;          /* Sum of the squared deviations from the mean */
+} DSP_STABILITY;
+
+
+/* Convert points [start, end) of the selected outputs of both chains and the cavity sums in one pass */
+void dspConvertFrame(const DSP_FRAME *frame, int start, int end);
+
+/* out[i] = in[i] * scale for points [start, end) */
+void dspScale(const short *in, double scale, double *out, int start, int end);
+
+/* out[i] = (float)in[i] for points [start, end), for Float32 publication */
+void dspNarrow(const double *in, float *out, int start, int end);
+
+/* Min and max of each bucket of factor points, in time order, so that no spike is lost.
+ * out holds 2 * ceil(length / factor) points, which is at most length + 1, the count is returned */
+int dspMinMax(const double *in, int length, int factor, double *out);
+
+/* sum[i] += in[i], the boxcar sum of the frames of one raw waveform */
+void dspAccumulate(const short *in, int *sum, int count);
+
+/* out[i] = sum[i] / frames rounded, frames is at most 256 so that the sums are exact in float and the quotient
+ * is rounded once */
+void dspAverage(const int *sum, int frames, short *out, int count);
+
+/* acc[i] += alpha * (in[i] - acc[i]), the exponential average of one raw waveform */
+void dspEma(const short *in, float alpha, float *acc, int count);
+
+/* out[i] = acc[i] rounded */
+void dspRound(const float *in, short *out, int count);
+
+/* Empty statistics */
+void dspStatsReset(DSP_STATS *stats);
+
+/* Add points [start, end), circular for a phase in degrees */
+void dspStatsAdd(DSP_STATS *stats, const double *in, int start, int end, int circular);
+
+/* Add the points of other, e.g. accumulated by another thread */
+void dspStatsMerge(DSP_STATS *stats, const DSP_STATS *other);
+
+/* Mean, the circular mean in degrees for a phase, and RMS of the points added */
+double dspStatsMean(const DSP_STATS *stats, int circular);
+double dspStatsRms(const DSP_STATS *stats);
+
+/* Forget the values added, history must hold window values */
+void dspStabilityReset(DSP_STABILITY *stability, int window);
+
+/* Add the value of one pulse in O(1), a circular value in degrees is taken within 180 degrees of the mean */
+void dspStabilityAdd(DSP_STABILITY *stability, double value, int circular);
+
+/* Standard deviation of the values in the window */
+double dspStabilityStd(const DSP_STABILITY *stability);
+
+/* Hash of count points, to detect the raw waveforms unchanged since the previous frame */
+unsigned long long dspHash(const short *in, int count);
+
+/* Name of the conversion kernel selected for this CPU: "avx2", "sse2" or "scalar" */
+const char *dspEngineName(void);
+
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * cpciFft.c -- Amplitude spectrum of the EPICS waveforms
+ *
+ *        The n real points are packed into n / 2 complex points, even points as real part and
+ *        odd points as imaginary part, transformed by an iterative radix-2 FFT and split into
+ *        the spectrum of the real points. The bit reversal, the twiddles and the window are
+ *        tables of the plan, so a transform computes no sin() or cos().
+ *
+ * Author: Lin Wang (CSNS)
+ * Email:  wanglin@ihep.ac.cn
+ * Date:   November 14, 2022
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "cpciFft.h"
+
+
+#define FFT_PI 3.14159265358979323846
+
+
+FFT_PLAN *fftCreatePlan(int n)
+{
+    FFT_PLAN *plan;
+    int bits, i, j;
+
+    if(n < 4 || (n & (n - 1)) != 0) return NULL;
+
+    plan = (FFT_PLAN *)calloc(1, sizeof(FFT_PLAN));
+    if(plan == NULL) return NULL;
+    plan->n = n;
+    plan->half = n / 2;
+    plan->bitReverse = (int *)calloc(plan->half, sizeof(int));
+    plan->twiddleRe = (double *)calloc(plan->half, sizeof(double));
+    plan->twiddleIm = (double *)calloc(plan->half, sizeof(double));
+    plan->workRe = (double *)calloc(plan->half, sizeof(double));
+    plan->workIm = (double *)calloc(plan->half, sizeof(double));
+    plan->window = (double *)calloc(n, sizeof(double));
+    if(plan->bitReverse == NULL || plan->twiddleRe == NULL || plan->twiddleIm == NULL ||
+       plan->workRe == NULL || plan->workIm == NULL || plan->window == NULL) {
+        fftDestroyPlan(plan);
+        return NULL;
+    }
+
+    for(bits = 0; (1 << bits) < plan->half; bits++);
+    for(i = 0; i < plan->half; i++) {
+        for(j = 0, plan->bitReverse[i] = 0; j < bits; j++) {
+            if(i & (1 << j)) plan->bitReverse[i] |= 1 << (bits - 1 - j);
+        }
+        plan->twiddleRe[i] = cos(2 * FFT_PI * i / n);
+        plan->twiddleIm[i] = -sin(2 * FFT_PI * i / n);
+    }
+
+    /* No window table yet */
+    plan->windowType = -1;
+    plan->windowLength = 0;
+    return plan;
+}
+
+
+void fftDestroyPlan(FFT_PLAN *plan)
+{
+    if(plan == NULL) return;
+    free(plan->bitReverse);
+    free(plan->twiddleRe);
+    free(plan->twiddleIm);
+    free(plan->workRe);
+    free(plan->workIm);
+    free(plan->window);
+    free(plan);
+}
+
+
+/* Symmetric window of length points */
+static void fftWindow(FFT_PLAN *plan, int type, int length)
+{
+    double x;
+    int i;
+
+    plan->windowSum = 0;
+    for(i = 0; i < length; i++) {
+        x = (length > 1) ? 2 * FFT_PI * i / (length - 1) : 0;
+        switch(type) {
+        case FFT_WINDOW_HANN:
+            plan->window[i] = (length > 1) ? 0.5 - 0.5 * cos(x) : 1;
+            break;
+        case FFT_WINDOW_HAMMING:
+            plan->window[i] = (length > 1) ? 0.54 - 0.46 * cos(x) : 1;
+            break;
+        case FFT_WINDOW_BLACKMAN:
+            plan->window[i] = (length > 1) ? 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x) : 1;
+            break;
+        default:
+            plan->window[i] = 1;
+            break;
+        }
+        plan->windowSum += plan->window[i];
+    }
+
+    /* Hann and Blackman of 2 points are zero, about 0 with rounding, the spectrum falls back to no window.
+     * Any other window sums to at least 1 */
+    if(plan->windowSum < 0.5) {
+        for(i = 0; i < length; i++) {
+            plan->window[i] = 1;
+        }
+        plan->windowSum = length;
+    }
+    plan->windowType = type;
+    plan->windowLength = length;
+}
+
+
+void fftAmplitude(FFT_PLAN *plan, const double *in, int length, int window, double *out)
+{
+    double *re = plan->workRe;
+    double *im = plan->workIm;
+    double ur, ui, vr, vi, tr, ti, er, ei, or_, oi;
+    double scale;
+    int half = plan->half;
+    int span, step, start, i, k;
+
+    if(length > plan->n) length = plan->n;
+    if(length < 1) length = 1;
+    if(window != plan->windowType || length != plan->windowLength) {
+        fftWindow(plan, window, length);
+    }
+
+    /* Pack the windowed points in bit reversed order, zero padded */
+    for(i = 0; i < half; i++) {
+        k = plan->bitReverse[i];
+        re[k] = (2 * i < length) ? in[2 * i] * plan->window[2 * i] : 0;
+        im[k] = (2 * i + 1 < length) ? in[2 * i + 1] * plan->window[2 * i + 1] : 0;
+    }
+
+    /* Radix-2 butterflies, the twiddle of span s is the twiddle of n at the stride n / s */
+    for(span = 2; span <= half; span <<= 1) {
+        step = plan->n / span;
+        for(start = 0; start < half; start += span) {
+            for(i = 0; i < span / 2; i++) {
+                tr = plan->twiddleRe[i * step];
+                ti = plan->twiddleIm[i * step];
+                k = start + i + span / 2;
+                vr = re[k] * tr - im[k] * ti;
+                vi = re[k] * ti + im[k] * tr;
+                ur = re[start + i];
+                ui = im[start + i];
+                re[start + i] = ur + vr;
+                im[start + i] = ui + vi;
+                re[k] = ur - vr;
+                im[k] = ui - vi;
+            }
+        }
+    }
+
+    /* Split: X[k] = E[k] + W^k O[k], E and O are the spectra of the even and the odd points.
+     * The single sided amplitude doubles the bins other than 0 and n / 2 */
+    scale = 1 / plan->windowSum;
+    out[0] = fabs(re[0] + im[0]) * scale;
+    out[half] = fabs(re[0] - im[0]) * scale;
+    for(k = 1; k < half; k++) {
+        er = (re[k] + re[half - k]) / 2;
+        ei = (im[k] - im[half - k]) / 2;
+        or_ = (im[k] + im[half - k]) / 2;
+        oi = -(re[k] - re[half - k]) / 2;
+        tr = plan->twiddleRe[k] * or_ - plan->twiddleIm[k] * oi;
+        ti = plan->twiddleRe[k] * oi + plan->twiddleIm[k] * or_;
+        out[k] = 2 * sqrt((er + tr) * (er + tr) + (ei + ti) * (ei + ti)) * scale;
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * cpciFft.h -- Amplitude spectrum of the EPICS waveforms
+ *
+ * Author: Lin Wang (CSNS)
+ * Email:  wanglin@ihep.ac.cn
+ * Date:   November 14, 2022
+ *
+ */
+#ifndef CPCI_FFT_H
+#define CPCI_FFT_H
+
+
+/* Window applied to the points before the transform */
+#define FFT_WINDOW_RECT     0
+#define FFT_WINDOW_HANN     1
+#define FFT_WINDOW_HAMMING  2
+#define FFT_WINDOW_BLACKMAN 3
+
+
+/* Real transform of n points, tables computed once by fftCreatePlan() */
+typedef struct _FFT_PLAN
+{
+    int n;                /* Real points, a power of 2 */
+    int half;             /* Complex points of the transform, n / 2 */
+    int *bitReverse;      /* half entries */
+    double *twiddleRe;    /* cos(2 pi k / n), k < half */
+    double *twiddleIm;    /* -sin(2 pi k / n), k < half */
+    double *workRe;       /* half entries, the plan is used by one thread at a time */
+    double *workIm;
+
+    int windowType;       /* Window of the table, recomputed when the type or the length changes */
+    int windowLength;
+    double *window;       /* n entries */
+    double windowSum;
+} FFT_PLAN;
+
+
+/* Plan of n points, NULL if n is not a power of 2 of at least 4 or no memory */
+FFT_PLAN *fftCreatePlan(int n);
+
+void fftDestroyPlan(FFT_PLAN *plan);
+
+/* Amplitude spectrum of length points of in, windowed and zero padded to n points.
+ * out holds n / 2 + 1 bins, bin k is at k / n of the sampling frequency */
+void fftAmplitude(FFT_PLAN *plan, const double *in, int length, int window, double *out);
+
+
+#endif
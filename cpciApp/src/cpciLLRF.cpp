@@ -22,6 +22,7 @@
 #include <epicsTimer.h>
 #include <epicsMutex.h>
 #include <epicsEvent.h>
+#include <ellLib.h>
 #include <iocsh.h>
 #include <epicsExport.h>
 
@@ -38,123 +39,250 @@ extern "C" {
  *
  */
 PCI_REG_INFO cpciLLRF::registers[] = {
-    //      Register name                      Offset               Data type
+    //      Register name                      Offset               Data type               Conversion            Pulse width (s)
     // Read/Write registers
-    {       "lock_en",                          0,                  asynParamInt32          },
-    {       "on_off", 	                        4,                  asynParamInt32          },
-    {       "RF_PW_CW",                         8,                  asynParamInt32          },
-    {       "loop_en", 	                        12,                 asynParamInt32          },
-    {       "tune_loop_en", 	                16,                 asynParamInt32          },
-    {       "sp_amp", 	                        20,                 asynParamInt32          },
-    {       "sp_phase", 	                    24,                 asynParamFloat64        },
-    {       "beam_amp", 	                    28,                 asynParamInt32          },
-    {       "beam_phase",	                    32,                 asynParamFloat64        },
-    {       "kp",	                            36,                 asynParamInt32          },
-    {       "ki",	                            40,                 asynParamInt32          },
-    {       "ad_adj_real",	                    44,                 asynParamFloat64        },
-    {       "ad_adj_imag",	                    48,                 asynParamFloat64        },
-    {       "da_adj_real", 	                    52,                 asynParamFloat64        },
-    {       "da_adj_imag", 	                    56,                 asynParamFloat64        },
-    {       "da_adj_real2", 	                60,                 asynParamFloat64        },
-    {       "da_adj_imag2", 	                64,                 asynParamFloat64        },
-    {       "n_jump",       	                68,                 asynParamInt32          },
-    {       "n_jump_delay", 	                72,                 asynParamInt32          },
-    {       "start_cnt",       	                76,                 asynParamInt32          },
-    {       "end_cnt", 	                        80,                 asynParamInt32          },
-    {       "Out_max_I",	                    84,                 asynParamInt32          },
-    {       "Out_min_I", 	                    88,                 asynParamInt32          },
-    {       "Out_max_Q", 	                    92,                 asynParamInt32          },
-    {       "Out_min_Q", 	                    96,                 asynParamInt32          },
-    {       "sp_freq",                     	    100,                asynParamInt32          },
-    {       "Loop_Delay_count", 	            104,                asynParamInt32          },
-    {       "Kip_start_point", 	                108,                asynParamInt32          },
-    {       "Kip_end_point", 	                112,                asynParamInt32          },
-    {       "Ki_I_rise_point", 	                116,                asynParamInt32          },
-    {       "Ki_Q_rise_point", 	                120,                asynParamInt32          },
-    {       "freq_kp", 	                        124,                asynParamInt32          },
-    {       "beam_delay",                       128,                asynParamInt32          },
-    {       "rfgate_ram_jiange", 	            132,                asynParamInt32          },
-    {       "Qset",                 	        136,                asynParamInt32          },
-    {       "Overdrive",            	        140,                asynParamFloat64        },
-    {       "train_mode",            	        144,                asynParamInt32          },
-    {       "triger_src",	                    148,                asynParamInt32          },
-    {       "triger_period",	                152,                asynParamInt32          },
-    {       "RF_count",              	        156,                asynParamInt32          },
-    {       "init_set",              	        160,                asynParamInt32          },
-    {       "end_set",               	        164,                asynParamInt32          },
-    {       "powup_time",            	        168,                asynParamInt32          },
-    {       "powup_step",            	        172,                asynParamInt32          },
-    {       "powup_hold_time",       	        176,                asynParamInt32          },
-    {       "powup_protect_times",   	        180,                asynParamInt32          },
-    {       "powdown_time",          	        184,                asynParamInt32          },
-    {       "powdown_step",          	        188,                asynParamInt32          },
-    {       "powdown_hold_time",             	192,                asynParamInt32          },
-    {       "powdown_protect_times", 	        196,                asynParamInt32          },
-    {       "PRT_Start_count",            	    200,                asynParamInt32          },
-    {       "PRT_End_count",         	        204,                asynParamInt32          },
-    {       "SP_P",                  	        208,                asynParamFloat64        },
-    {       "SP_P_1",                	        212,                asynParamFloat64        },
-    {       "SP_P_2",                	        216,                asynParamFloat64        },
-    {       "SP_P_3",                	        220,                asynParamFloat64        },
-    {       "Ch_beam_Hold",          	        224,                asynParamInt32          },
-    {       "Ch_VSWR_Hold",          	        228,                asynParamFloat64        },
-    {       "SP_Ch_sum_PRT_Num",     	        232,                asynParamInt32          },
-    {       "manual_Clear",          	        236,                asynParamInt32          },
-    {       "VSWR_EN",               	        240,                asynParamInt32          },
-    {       "VSWR_Delay_Num",        	        244,                asynParamInt32          },
-    {       "k0_forward",            	        248,                asynParamInt32          },
-    {       "k0_reverse",            	        252,                asynParamInt32          },
-    {       "k1_forward",            	        256,                asynParamInt32          },
-    {       "k1_reverse",            	        260,	            asynParamInt32          },
-    {       "k2_forward",            	        264,	            asynParamInt32          },
-    {       "k2_reverse",            	        268,	            asynParamInt32          },
-    {       "k3_forward",           	        272,	            asynParamInt32          },
-    {       "k3_reverse",            	        276,	            asynParamInt32          },
-    {       "state_wr_reg",	                    508,	            asynParamInt32          },
+    {       "lock_en",                          0,                  asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "on_off", 	                        4,                  asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "RF_PW_CW",                         8,                  asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "loop_en", 	                        12,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "tune_loop_en", 	                16,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "sp_amp", 	                        20,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "sp_phase", 	                    24,                 asynParamFloat64,       REG_CONV_PHASE,       0           },
+    {       "beam_amp", 	                    28,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "beam_phase",	                    32,                 asynParamFloat64,       REG_CONV_PHASE,       0           },
+    {       "kp",	                            36,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "ki",	                            40,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "ad_adj_real",	                    44,                 asynParamFloat64,       REG_CONV_ADJ_REAL,    0           },
+    {       "ad_adj_imag",	                    48,                 asynParamFloat64,       REG_CONV_PHASE,       0           },
+    {       "da_adj_real", 	                    52,                 asynParamFloat64,       REG_CONV_ADJ_REAL,    0           },
+    {       "da_adj_imag", 	                    56,                 asynParamFloat64,       REG_CONV_PHASE,       0           },
+    {       "da_adj_real2", 	                60,                 asynParamFloat64,       REG_CONV_ADJ_REAL,    0           },
+    {       "da_adj_imag2", 	                64,                 asynParamFloat64,       REG_CONV_PHASE,       0           },
+    {       "n_jump",       	                68,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "n_jump_delay", 	                72,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "start_cnt",       	                76,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "end_cnt", 	                        80,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Out_max_I",	                    84,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Out_min_I", 	                    88,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Out_max_Q", 	                    92,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Out_min_Q", 	                    96,                 asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "sp_freq",                     	    100,                asynParamInt32,         REG_CONV_FREQ,        0           },
+    {       "Loop_Delay_count", 	            104,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Kip_start_point", 	                108,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Kip_end_point", 	                112,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Ki_I_rise_point", 	                116,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Ki_Q_rise_point", 	                120,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "freq_kp", 	                        124,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "beam_delay",                       128,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "rfgate_ram_jiange", 	            132,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Qset",                 	        136,                asynParamInt32,         REG_CONV_QSET,        0           },
+    {       "Overdrive",            	        140,                asynParamFloat64,       REG_CONV_OVERDRIVE,   0           },
+    {       "train_mode",            	        144,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "triger_src",	                    148,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "triger_period",	                152,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "RF_count",              	        156,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "init_set",              	        160,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "end_set",               	        164,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "powup_time",            	        168,                asynParamInt32,         REG_CONV_POW_TIME,    0           },
+    {       "powup_step",            	        172,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "powup_hold_time",       	        176,                asynParamInt32,         REG_CONV_POW_TIME,    0           },
+    {       "powup_protect_times",   	        180,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "powdown_time",          	        184,                asynParamInt32,         REG_CONV_POW_TIME,    0           },
+    {       "powdown_step",          	        188,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "powdown_hold_time",             	192,                asynParamInt32,         REG_CONV_POW_TIME,    0           },
+    {       "powdown_protect_times", 	        196,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "PRT_Start_count",            	    200,                asynParamInt32,         REG_CONV_PRT_COUNT,   0           },
+    {       "PRT_End_count",         	        204,                asynParamInt32,         REG_CONV_PRT_COUNT,   0           },
+    {       "SP_P",                  	        208,                asynParamFloat64,       REG_CONV_SP_P,        0           },
+    {       "SP_P_1",                	        212,                asynParamFloat64,       REG_CONV_SP_P_1,      0           },
+    {       "SP_P_2",                	        216,                asynParamFloat64,       REG_CONV_SP_P_2,      0           },
+    {       "SP_P_3",                	        220,                asynParamFloat64,       REG_CONV_SP_P_3,      0           },
+    {       "Ch_beam_Hold",          	        224,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "Ch_VSWR_Hold",          	        228,                asynParamFloat64,       REG_CONV_VSWR_HOLD,   0           },
+    {       "SP_Ch_sum_PRT_Num",     	        232,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "manual_Clear",          	        236,                asynParamInt32,         REG_CONV_NONE,        0.5         },
+    {       "VSWR_EN",               	        240,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "VSWR_Delay_Num",        	        244,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k0_forward",            	        248,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k0_reverse",            	        252,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k1_forward",            	        256,                asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k1_reverse",            	        260,	            asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k2_forward",            	        264,	            asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k2_reverse",            	        268,	            asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k3_forward",           	        272,	            asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "k3_reverse",            	        276,	            asynParamInt32,         REG_CONV_NONE,        0           },
+    {       "state_wr_reg",	                    508,	            asynParamInt32,         REG_CONV_NONE,        0           },
 
     // Read-only registers
-    {		"rd_reg_state",						508,				asynParamInt32			},
-	{		"lock_en_state",					512,				asynParamInt32			},
-	{		"on_off_state",						516,				asynParamInt32			},
-	{		"loop_en_state",					520,				asynParamInt32			},
-	{		"tune_loop_en_state",				524,				asynParamInt32			},
-	{		"o_sp_amp_state",					528,				asynParamInt32			},
-	{		"sp_amp_state",						532,				asynParamInt32			},
-	{		"sp_phase_state",					536,				asynParamFloat64		},
-	{		"s1_Ch0_PRT_Num_state",				540,				asynParamInt32			},
-	{		"s1_Ch1_PRT_Num_state",				544,				asynParamInt32			},
-	{		"s1_Ch2_PRT_Num_state",				548,				asynParamInt32			},
-	{		"s1_Ch3_PRT_Num_state",				552,				asynParamInt32			},
-	{		"s1_Ch_sum_PRT_Num_state",			556,				asynParamInt32			},
-	{		"Ch0_VSWR_SUM_Counter_state",		560,				asynParamInt32			},
-	{		"Ch1_VSWR_SUM_Counter_state",		564,				asynParamInt32			},
-	{		"Ch2_VSWR_SUM_Counter_state",		568,				asynParamInt32			},
-	{		"Ch3_VSWR_SUM_Counter_state",		572,				asynParamInt32			},
-	{		"high_Wattcher_state",				576,				asynParamInt32			},
-	{		"VSWR_PRT_forvere_out_state",		580,				asynParamInt32			},
-	{		"freq_cal_state",					584,				asynParamFloat64		},
+    {		"rd_reg_state",						508,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"lock_en_state",					512,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"on_off_state",						516,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"loop_en_state",					520,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"tune_loop_en_state",				524,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"o_sp_amp_state",					528,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"sp_amp_state",						532,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"sp_phase_state",					536,				asynParamFloat64,       REG_CONV_PHASE,       0           },
+	{		"s1_Ch0_PRT_Num_state",				540,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"s1_Ch1_PRT_Num_state",				544,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"s1_Ch2_PRT_Num_state",				548,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"s1_Ch3_PRT_Num_state",				552,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"s1_Ch_sum_PRT_Num_state",			556,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"Ch0_VSWR_SUM_Counter_state",		560,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"Ch1_VSWR_SUM_Counter_state",		564,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"Ch2_VSWR_SUM_Counter_state",		568,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"Ch3_VSWR_SUM_Counter_state",		572,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"high_Wattcher_state",				576,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"VSWR_PRT_forvere_out_state",		580,				asynParamInt32,         REG_CONV_NONE,        0           },
+	{		"freq_cal_state",					584,				asynParamFloat64,       REG_CONV_FREQ_CAL,    0           },
 };
 
 int cpciLLRF::regCount = sizeof(registers) / sizeof(PCI_REG_INFO);
 
 
+/* Parameter names of WAVEFORM_OUTPUT, "waveform_" and "waveform_single_point_" are prepended */
+const char *cpciLLRF::waveformNames[] = {
+    "CAV2_amp",
+    "CAV2_phase",
+    "CAV1_amp",
+    "CAV1_phase",
+
+    "fwd1_amp",
+    "fwd1_phase",
+    "fwd1_power",
+    "rfl1_amp",
+    "rfl1_phase",
+    "rfl1_power",
+    "CAV_VSWR1",
+
+    "fwd2_amp",
+    "fwd2_phase",
+    "fwd2_power",
+    "rfl2_amp",
+    "rfl2_phase",
+    "rfl2_power",
+    "CAV_VSWR2",
+
+    "CAV_inpower",
+    "CAV_fwdpower",
+    "CAV_rflpower",
+
+    "DAC_amp",
+    "DAC_phase",
+};
+
+
+/* Change detection groups of the raw channels and of the outputs */
+const int cpciLLRF::rawGroups[WAVEFORM_NUMBER] = {
+    GROUP_CAV2, GROUP_CAV2,
+    GROUP_CAV1, GROUP_CAV1,
+    GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS,
+    GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS,
+    GROUP_DAC, GROUP_DAC,
+};
+
+const int cpciLLRF::outputGroups[WF_OUTPUT_NUMBER] = {
+    GROUP_CAV2, GROUP_CAV2,
+    GROUP_CAV1, GROUP_CAV1,
+    GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS,
+    GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS,
+    GROUP_RF_CHAINS, GROUP_RF_CHAINS, GROUP_RF_CHAINS,
+    GROUP_DAC, GROUP_DAC,
+};
+
+
+/* Raw channels of the outputs, the magnitude kernel of a chain needs its four channels */
+#define CHANNEL(c) (1 << (c))
+#define CHAIN1_CHANNELS (CHANNEL(RAW_FWD1_I) | CHANNEL(RAW_FWD1_Q) | CHANNEL(RAW_RFL1_I) | CHANNEL(RAW_RFL1_Q))
+#define CHAIN2_CHANNELS (CHANNEL(RAW_FWD2_I) | CHANNEL(RAW_FWD2_Q) | CHANNEL(RAW_RFL2_I) | CHANNEL(RAW_RFL2_Q))
+
+const int cpciLLRF::outputChannels[WF_OUTPUT_NUMBER] = {
+    CHANNEL(RAW_CAV2_AMP),
+    CHANNEL(RAW_CAV2_PHASE),
+    CHANNEL(RAW_CAV1_AMP),
+    CHANNEL(RAW_CAV1_PHASE),
+
+    CHAIN1_CHANNELS,
+    CHANNEL(RAW_FWD1_I) | CHANNEL(RAW_FWD1_Q),
+    CHAIN1_CHANNELS,
+    CHAIN1_CHANNELS,
+    CHANNEL(RAW_RFL1_I) | CHANNEL(RAW_RFL1_Q),
+    CHAIN1_CHANNELS,
+    CHAIN1_CHANNELS,
+
+    CHAIN2_CHANNELS,
+    CHANNEL(RAW_FWD2_I) | CHANNEL(RAW_FWD2_Q),
+    CHAIN2_CHANNELS,
+    CHAIN2_CHANNELS,
+    CHANNEL(RAW_RFL2_I) | CHANNEL(RAW_RFL2_Q),
+    CHAIN2_CHANNELS,
+    CHAIN2_CHANNELS,
+
+    CHAIN1_CHANNELS | CHAIN2_CHANNELS,
+    CHAIN1_CHANNELS | CHAIN2_CHANNELS,
+    CHAIN1_CHANNELS | CHAIN2_CHANNELS,
+
+    CHANNEL(RAW_DAC_AMP),
+    CHANNEL(RAW_DAC_PHASE),
+};
+
+/* Outputs with the circular mean */
+#define PHASE_OUTPUTS ((1 << WF_CAV2_PHASE) | (1 << WF_CAV1_PHASE) | (1 << WF_FWD1_PHASE) | (1 << WF_RFL1_PHASE) | \
+                       (1 << WF_FWD2_PHASE) | (1 << WF_RFL2_PHASE) | (1 << WF_DAC_PHASE))
+
+const int cpciLLRF::stabilityOutputs[STAB_OUTPUT_NUMBER] = {
+    WF_CAV2_AMP,
+    WF_CAV2_PHASE,
+    WF_CAV1_AMP,
+    WF_CAV1_PHASE,
+    WF_FWD1_AMP,
+    WF_FWD1_PHASE,
+    WF_FWD2_AMP,
+    WF_FWD2_PHASE,
+};
+
+/* Outputs that are a raw channel times a scale */
+static const struct
+{
+    int raw;
+    int output;
+    double scale;
+} scaledOutputs[] = {
+    { RAW_CAV2_AMP,     WF_CAV2_AMP,     1.0           },
+    { RAW_CAV2_PHASE,   WF_CAV2_PHASE,   180.0 / 32768 },
+    { RAW_CAV1_AMP,     WF_CAV1_AMP,     1.0           },
+    { RAW_CAV1_PHASE,   WF_CAV1_PHASE,   180.0 / 32768 },
+    { RAW_DAC_AMP,      WF_DAC_AMP,      1.0           },
+    { RAW_DAC_PHASE,    WF_DAC_PHASE,    180.0 / 32768 },
+};
+
+/* Outputs of the fused magnitude kernel of each chain */
+#define CHAIN1_MAGNITUDE_OUTPUTS ((1 << WF_FWD1_AMP) | (1 << WF_FWD1_POWER) | (1 << WF_RFL1_AMP) | (1 << WF_RFL1_POWER) | (1 << WF_CAV_VSWR1))
+#define CHAIN2_MAGNITUDE_OUTPUTS ((1 << WF_FWD2_AMP) | (1 << WF_FWD2_POWER) | (1 << WF_RFL2_AMP) | (1 << WF_RFL2_POWER) | (1 << WF_CAV_VSWR2))
+#define SUM_OUTPUTS ((1 << WF_CAV_INPOWER) | (1 << WF_CAV_FWDPOWER) | (1 << WF_CAV_RFLPOWER))
+
+
 static const char *driverName="cpciLLRF";
 void pollerThreadC(void *drvPvt);
+void processThreadC(void *drvPvt);
+void publishThreadC(void *drvPvt);
+void workerThreadC(void *drvPvt);
+void pulseTimerC(void *drvPvt);
 
 
-cpciLLRF::cpciLLRF(const char *portName)
+cpciLLRF::cpciLLRF(const char *portName, int workerCount)
    : asynPortDriver(portName,
                     1, /* maxAddr */
-                    asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask | asynDrvUserMask, /* Interface mask */
-                    asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask,  /* Interrupt mask */
-                    0, /* asynFlags.  This driver does not block and it is not multi-device, so flag is 0 */
+                    asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask | asynFloat32ArrayMask | asynInt16ArrayMask | asynInt32ArrayMask | asynDrvUserMask, /* Interface mask */
+                    asynInt32Mask | asynFloat64Mask | asynFloat64ArrayMask | asynFloat32ArrayMask | asynInt16ArrayMask | asynInt32ArrayMask,  /* Interrupt mask */
+                    ASYN_CANBLOCK, /* asynFlags.  Register access blocks, it runs in the port thread, and it is not multi-device */
                     1, /* Autoconnect */
-                    0, /* Default priority */
+                    0, /* Default priority of the port thread, the records queue with their PRIO */
                     0) /* Default stack size*/
 {
     asynStatus status;
     const char *functionName = "cpciLLRF";
     int dummy;
+    IO_DEV_INFO devInfo;
     
     fd = openDevice((char *)DEVICE_NAME);
     if(fd == -1) {
@@ -162,75 +290,268 @@ cpciLLRF::cpciLLRF(const char *portName)
     } else {
         printf("cpciLLRF::cpciLLRF: openDevice() success - DEVICE_NAME %s - fd %d\n", DEVICE_NAME, fd);
     }
+
+    /* Use DMA for the waveforms if the driver supports it */
+    useDma = (deviceInfoRead(fd, &devInfo) == OK && devInfo.dmaSlotCount > 0 && devInfo.dmaSlotSize >= WAVEFORM_LENGTH);
+    printf("cpciLLRF::cpciLLRF: waveform read by %s%s\n", useDma ? "DMA" : "MMIO", (useDma && devInfo.mock) ? " (mock device)" : "");
+
+    /* Process each frame on the waveform ready interrupt if the driver delivers it, otherwise poll */
+    useIrq = (devInfo.irq != 0);
+    printf("cpciLLRF::cpciLLRF: waveform ready by %s\n", useIrq ? "interrupt" : "polling");
+
+    /* Frame buffers of the pipeline, all free at start */
+    freeQueue = epicsMessageQueueCreate(FRAME_COUNT, sizeof(LLRF_FRAME *));
+    processQueue = epicsMessageQueueCreate(FRAME_COUNT, sizeof(LLRF_FRAME *));
+    publishQueue = epicsMessageQueueCreate(FRAME_COUNT, sizeof(LLRF_FRAME *));
+    droppedFrames = 0;
+    memset(rawHashes, 0, sizeof(rawHashes));
+    memset(&lastSettings, -1, sizeof(lastSettings)); /* The first frame is processed whole */
+    for(int i=0; i<FRAME_COUNT; i++) {
+        /* Cache line aligned, the blocks of the worker threads do not share a line */
+        if(posix_memalign((void **)&frames[i], 64, sizeof(LLRF_FRAME)) != 0) {
+            printf("%s:%s: posix_memalign failure, %d frames in the pipeline\n", driverName, functionName, i);
+            break;
+        }
+        memset(frames[i], 0, sizeof(LLRF_FRAME));
+        initFrame(frames[i]);
+        epicsMessageQueueSend(freeQueue, &frames[i], sizeof(LLRF_FRAME *));
+    }
+    printf("cpciLLRF::cpciLLRF: waveform conversion kernel %s\n", dspEngineName());
+
+    /* Tables of the spectrum computed once */
+    fftPlan = fftCreatePlan(WAVEFORM_POINT);
+    if(fftPlan == NULL) {
+        printf("%s:%s: fftCreatePlan failure, no spectrum is computed\n", driverName, functionName);
+    }
         
-    /**** Register parameters ****/
+    /**** Register parameters, a reason out of order would map the parameters to the wrong offsets ****/
+    regParamsValid = true;
     for(int i=0; i<regCount; i++) {
         createParam(registers[i].name, registers[i].type, &dummy);
+        if(i == 0) firstRegParam = dummy;
+        if(dummy != firstRegParam + i) {
+            printf("%s:%s: register parameter %s is not consecutive, register access disabled\n",
+                   driverName, functionName, registers[i].name);
+            regParamsValid = false;
+        }
+    }
+    findParam("start_cnt", &startCntReason);
+    findParam("end_cnt", &endCntReason);
+
+    /* Timers of the pulse registers, they write 0 back once the pulse width has elapsed */
+    pulseQueue = epicsTimerQueueAllocate(1, epicsThreadPriorityScanHigh);
+    regPulses = (REG_PULSE *)calloc(regCount, sizeof(REG_PULSE));
+    for(int i=0; i<regCount; i++) {
+        regPulses[i].owner = this;
+        regPulses[i].index = i;
+        regPulses[i].armed = false;
+        if(registers[i].pulseWidth > 0) {
+            regPulses[i].timer = epicsTimerQueueCreateTimer(pulseQueue, ::pulseTimerC, &regPulses[i]);
+        }
     }
 
+    /* Snapshot of the registers, refreshed by the poller thread */
+    regSnapshot = (IO_REG_ENTRY *)calloc(regCount, sizeof(IO_REG_ENTRY));
+    for(int i=0; i<regCount; i++) {
+        regSnapshot[i].offset = registers[i].offset;
+        regSnapshot[i].width = 4;
+    }
+    lastRefresh.secPastEpoch = 0;
+    lastRefresh.nsec = 0;
+    lastRead = lastRefresh;
+    irqTimeouts = 0;
+
     /**** Waveform parameters ****/
-    createParam("waveform_CAV2_amp", asynParamFloat64Array, &_waveform_CAV2_amp);
-    createParam("waveform_CAV2_phase", asynParamFloat64Array, &_waveform_CAV2_phase);
-    createParam("waveform_CAV1_amp", asynParamFloat64Array, &_waveform_CAV1_amp);
-    createParam("waveform_CAV1_phase", asynParamFloat64Array, &_waveform_CAV1_phase);
-
-    createParam("waveform_fwd1_amp", asynParamFloat64Array, &_waveform_fwd1_amp);
-    createParam("waveform_fwd1_phase", asynParamFloat64Array, &_waveform_fwd1_phase);
-    createParam("waveform_fwd1_power", asynParamFloat64Array, &_waveform_fwd1_power);
-    createParam("waveform_rfl1_amp", asynParamFloat64Array, &_waveform_rfl1_amp);
-    createParam("waveform_rfl1_phase", asynParamFloat64Array, &_waveform_rfl1_phase);
-    createParam("waveform_rfl1_power", asynParamFloat64Array, &_waveform_rfl1_power);
-    createParam("waveform_CAV_VSWR1", asynParamFloat64Array, &_waveform_CAV_VSWR1);
-
-    createParam("waveform_fwd2_amp", asynParamFloat64Array, &_waveform_fwd2_amp);
-    createParam("waveform_fwd2_phase", asynParamFloat64Array, &_waveform_fwd2_phase);
-    createParam("waveform_fwd2_power", asynParamFloat64Array, &_waveform_fwd2_power);
-    createParam("waveform_rfl2_amp", asynParamFloat64Array, &_waveform_rfl2_amp);
-    createParam("waveform_rfl2_phase", asynParamFloat64Array, &_waveform_rfl2_phase);
-    createParam("waveform_rfl2_power", asynParamFloat64Array, &_waveform_rfl2_power);
-    createParam("waveform_CAV_VSWR2", asynParamFloat64Array, &_waveform_CAV_VSWR2);
-
-    createParam("waveform_CAV_inpower", asynParamFloat64Array, &_waveform_CAV_inpower);
-    createParam("waveform_CAV_fwdpower", asynParamFloat64Array, &_waveform_CAV_fwdpower);
-    createParam("waveform_CAV_rflpower", asynParamFloat64Array, &_waveform_CAV_rflpower);
-
-    createParam("waveform_DAC_amp", asynParamFloat64Array, &_waveform_DAC_amp);
-    createParam("waveform_DAC_phase", asynParamFloat64Array, &_waveform_DAC_phase);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "waveform_%s", waveformNames[i]);
+        createParam(paramName, asynParamFloat64Array, &_waveform[i]);
+    }
+
+    /**** Float32 waveform parameters, published instead of the Float64 waveforms for the outputs selected by float32_mask ****/
+    createParam("float32_mask", asynParamInt32, &_float32_mask);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "waveform_f32_%s", waveformNames[i]);
+        createParam(paramName, asynParamFloat32Array, &_waveform_f32[i]);
+    }
+
+    /**** Decimated waveform parameters, published when decimation_factor is above 1 ****/
+    createParam("decimation_factor", asynParamInt32, &_decimation_factor);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "waveform_dec_%s", waveformNames[i]);
+        createParam(paramName, asynParamFloat64Array, &_waveform_dec[i]);
+    }
+
+    /**** Amplitude spectrum parameters, published for the outputs selected by spectrum_mask ****/
+    createParam("spectrum_mask", asynParamInt32, &_spectrum_mask);
+    createParam("spectrum_window", asynParamInt32, &_spectrum_window);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "spectrum_%s", waveformNames[i]);
+        createParam(paramName, asynParamFloat64Array, &_spectrum[i]);
+    }
+
+    /**** Raw waveform parameters, the int16 channels as read from FPGA ****/
+    for(int i=0; i<WAVEFORM_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "waveform_raw_%d", i);
+        createParam(paramName, asynParamInt16Array, &_waveform_raw[i]);
+    }
 
     /**** Waveform single point position ****/
     createParam("waveform_single_point_position", asynParamInt32, &_waveform_single_point_position);
 
+    /**** Phase computation mode ****/
+    createParam("phase_mode", asynParamInt32, &_phase_mode);
+
+    /**** Window statistics, the window is in the whole frame and only its part in the region of interest is used ****/
+    createParam("stats_start", asynParamInt32, &_stats_start);
+    createParam("stats_length", asynParamInt32, &_stats_length);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "stats_%s_min", waveformNames[i]);
+        createParam(paramName, asynParamFloat64, &_stats_min[i]);
+        snprintf(paramName, sizeof(paramName), "stats_%s_max", waveformNames[i]);
+        createParam(paramName, asynParamFloat64, &_stats_max[i]);
+        snprintf(paramName, sizeof(paramName), "stats_%s_mean", waveformNames[i]);
+        createParam(paramName, asynParamFloat64, &_stats_mean[i]);
+        snprintf(paramName, sizeof(paramName), "stats_%s_rms", waveformNames[i]);
+        createParam(paramName, asynParamFloat64, &_stats_rms[i]);
+    }
+
+    /**** Pulse-to-pulse stability of the window means ****/
+    createParam("stability_window", asynParamInt32, &_stability_window);
+    createParam("stability_reset", asynParamInt32, &_stability_reset);
+    for(int i=0; i<STAB_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "stability_%s_mean", waveformNames[stabilityOutputs[i]]);
+        createParam(paramName, asynParamFloat64, &_stability_mean[i]);
+        snprintf(paramName, sizeof(paramName), "stability_%s", waveformNames[stabilityOutputs[i]]);
+        createParam(paramName, asynParamFloat64, &_stability[i]);
+    }
+    for(int i=0; i<STAB_OUTPUT_NUMBER; i++) {
+        stability[i].history = (double *)calloc(STABILITY_WINDOW_MAX, sizeof(double));
+        dspStabilityReset(&stability[i], 0);
+    }
+    stabilityReset = false;
+
+    /**** Multi-frame averaging of the raw waveforms ****/
+    createParam("average_mode", asynParamInt32, &_average_mode);
+    createParam("average_count", asynParamInt32, &_average_count);
+    createParam("average_alpha", asynParamFloat64, &_average_alpha);
+    average.sum = (int *)calloc(WAVEFORM_NUMBER*WAVEFORM_POINT, sizeof(int));
+    average.acc = (float *)calloc(WAVEFORM_NUMBER*WAVEFORM_POINT, sizeof(float));
+    average.mode = AVERAGE_OFF;
+    average.count = 1;
+    average.alpha = 1;
+    average.channelMask = CHANNEL_ALL;
+    average.frames = 0;
+    average.started = false;
+
+    /**** Readout mask of the raw channels ****/
+    createParam("channel_mask", asynParamInt32, &_channel_mask);
+    createParam("irq_timeouts", asynParamInt32, &_irq_timeouts);
+    createParam("dropped_frames", asynParamInt32, &_dropped_frames);
+
+    /**** Region of interest ****/
+    createParam("roi_mode", asynParamInt32, &_roi_mode);
+    createParam("roi_start", asynParamInt32, &_roi_start);
+    createParam("roi_length", asynParamInt32, &_roi_length);
+
+    /**** Probe sets, positions and averaging width in, values of all the outputs out ****/
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "probe_positions_%d", i);
+        createParam(paramName, asynParamInt32Array, &_probe_positions[i]);
+        snprintf(paramName, sizeof(paramName), "probe_width_%d", i);
+        createParam(paramName, asynParamInt32, &_probe_width[i]);
+        snprintf(paramName, sizeof(paramName), "probe_values_%d", i);
+        createParam(paramName, asynParamFloat64Array, &_probe_values[i]);
+        probeSets[i].count = 0;
+        probeSets[i].width = 1;
+        for(int j=0; j<PROBE_VALUE_NUMBER; j++) {
+            probeValues[i][j] = NAN;
+        }
+    }
+    probeVersion = 0;
+
     /**** Waveform single point value ****/
-    createParam("waveform_single_point_CAV2_amp", asynParamFloat64, &_waveform_single_point_CAV2_amp);
-    createParam("waveform_single_point_CAV2_phase", asynParamFloat64, &_waveform_single_point_CAV2_phase);
-    createParam("waveform_single_point_CAV1_amp", asynParamFloat64, &_waveform_single_point_CAV1_amp);
-    createParam("waveform_single_point_CAV1_phase", asynParamFloat64, &_waveform_single_point_CAV1_phase);
-
-    createParam("waveform_single_point_fwd1_amp", asynParamFloat64, &_waveform_single_point_fwd1_amp);
-    createParam("waveform_single_point_fwd1_phase", asynParamFloat64, &_waveform_single_point_fwd1_phase);
-    createParam("waveform_single_point_fwd1_power", asynParamFloat64, &_waveform_single_point_fwd1_power);
-    createParam("waveform_single_point_rfl1_amp", asynParamFloat64, &_waveform_single_point_rfl1_amp);
-    createParam("waveform_single_point_rfl1_phase", asynParamFloat64, &_waveform_single_point_rfl1_phase);
-    createParam("waveform_single_point_rfl1_power", asynParamFloat64, &_waveform_single_point_rfl1_power);
-    createParam("waveform_single_point_CAV_VSWR1", asynParamFloat64, &_waveform_single_point_CAV_VSWR1);
-
-    createParam("waveform_single_point_fwd2_amp", asynParamFloat64, &_waveform_single_point_fwd2_amp);
-    createParam("waveform_single_point_fwd2_phase", asynParamFloat64, &_waveform_single_point_fwd2_phase);
-    createParam("waveform_single_point_fwd2_power", asynParamFloat64, &_waveform_single_point_fwd2_power);
-    createParam("waveform_single_point_rfl2_amp", asynParamFloat64, &_waveform_single_point_rfl2_amp);
-    createParam("waveform_single_point_rfl2_phase", asynParamFloat64, &_waveform_single_point_rfl2_phase);
-    createParam("waveform_single_point_rfl2_power", asynParamFloat64, &_waveform_single_point_rfl2_power);
-    createParam("waveform_single_point_CAV_VSWR2", asynParamFloat64, &_waveform_single_point_CAV_VSWR2);
-
-    createParam("waveform_single_point_CAV_inpower", asynParamFloat64, &_waveform_single_point_CAV_inpower);
-    createParam("waveform_single_point_CAV_fwdpower", asynParamFloat64, &_waveform_single_point_CAV_fwdpower);
-    createParam("waveform_single_point_CAV_rflpower", asynParamFloat64, &_waveform_single_point_CAV_rflpower);
-
-    createParam("waveform_single_point_DAC_amp", asynParamFloat64, &_waveform_single_point_DAC_amp);
-    createParam("waveform_single_point_DAC_phase", asynParamFloat64, &_waveform_single_point_DAC_phase);
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        char paramName[64];
+        snprintf(paramName, sizeof(paramName), "waveform_single_point_%s", waveformNames[i]);
+        createParam(paramName, asynParamFloat64, &_waveform_single_point[i]);
+    }
     
     /**** Local parameter initialization ****/
     setIntegerParam(_waveform_single_point_position, 0);
+    setIntegerParam(_phase_mode, DSP_PHASE_ACCURATE);
+    setIntegerParam(_float32_mask, 0);
+    setIntegerParam(_spectrum_mask, 0);
+    setIntegerParam(_spectrum_window, FFT_WINDOW_HANN);
+    setIntegerParam(_decimation_factor, DECIMATION_OFF);
+    setIntegerParam(_channel_mask, CHANNEL_ALL);
+    setIntegerParam(_irq_timeouts, 0);
+    setIntegerParam(_dropped_frames, 0);
+    setIntegerParam(_average_mode, AVERAGE_OFF);
+    setIntegerParam(_average_count, 1);
+    setDoubleParam(_average_alpha, 0.1);
+    setIntegerParam(_stats_start, 0);
+    setIntegerParam(_stats_length, WAVEFORM_POINT);
+    setIntegerParam(_stability_window, 0);
+    setIntegerParam(_stability_reset, 0);
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        setIntegerParam(_probe_width[i], 1);
+    }
+    setIntegerParam(_roi_mode, ROI_MODE_MANUAL);
+    setIntegerParam(_roi_start, 0);
+    setIntegerParam(_roi_length, WAVEFORM_POINT);
+
+    /* Create the threads sharing the conversion of each frame with the processing thread */
+    if(workerCount < 1) workerCount = 1;
+    if(workerCount > MAX_WORKER_COUNT) workerCount = MAX_WORKER_COUNT;
+    this->workerCount = 1;
+    for(int i=1; i<workerCount; i++) {
+        char threadName[32];
+        PROCESS_WORKER *worker = &workers[i];
+        worker->owner = this;
+        worker->startEvent = epicsEventMustCreate(epicsEventEmpty);
+        worker->doneEvent = epicsEventMustCreate(epicsEventEmpty);
+        snprintf(threadName, sizeof(threadName), "cpciLLRFWorker%d", i);
+        if(epicsThreadCreate(threadName,
+                             epicsThreadPriorityMedium,
+                             epicsThreadGetStackSize(epicsThreadStackMedium),
+                             (EPICSTHREADFUNC)::workerThreadC,
+                             worker) == NULL) {
+            printf("%s:%s: epicsThreadCreate failure for %s\n", driverName, functionName, threadName);
+            break;
+        }
+        this->workerCount++;
+    }
+    printf("cpciLLRF::cpciLLRF: each frame is processed by %d thread(s)\n", this->workerCount);
+
+    /* Create the thread that publishes the converted frames */
+    status = (asynStatus)(epicsThreadCreate("cpciLLRFPublish",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)::publishThreadC,
+                          this) == NULL);
+    if (status) {
+        printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+        return;
+    }
+
+    /* Create the thread that converts the acquired frames */
+    status = (asynStatus)(epicsThreadCreate("cpciLLRFProcess",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)::processThreadC,
+                          this) == NULL);
+    if (status) {
+        printf("%s:%s: epicsThreadCreate failure\n", driverName, functionName);
+        return;
+    }
 
     /* Create the thread that read the waveforms from hardware in the background */
     status = (asynStatus)(epicsThreadCreate("cpciLLRFTask",
@@ -253,157 +574,749 @@ void pollerThreadC(void *drvPvt)
 }
 
 
+void processThreadC(void *drvPvt)
+{
+    cpciLLRF *pPvt = (cpciLLRF *)drvPvt;
+
+    pPvt->processThread();
+}
+
+
+void publishThreadC(void *drvPvt)
+{
+    cpciLLRF *pPvt = (cpciLLRF *)drvPvt;
+
+    pPvt->publishThread();
+}
+
+
+void workerThreadC(void *drvPvt)
+{
+    PROCESS_WORKER *worker = (PROCESS_WORKER *)drvPvt;
+
+    worker->owner->workerThread(worker);
+}
+
+
+void pulseTimerC(void *drvPvt)
+{
+    REG_PULSE *pulse = (REG_PULSE *)drvPvt;
+
+    pulse->owner->pulseExpired(pulse);
+}
+
+
+/* Point the conversion of the RF chains at the raw and output waveforms of the frame */
+void cpciLLRF::initFrame(LLRF_FRAME *frame)
+{
+    /* The scales fold k * 10^(b/10) / 1000 of the power formula */
+    DSP_RF_CHAIN *chain1 = &frame->dsp.chain[0];
+    chain1->fwdI = RAW_WAVEFORM(frame, RAW_FWD1_I);
+    chain1->fwdQ = RAW_WAVEFORM(frame, RAW_FWD1_Q);
+    chain1->rflI = RAW_WAVEFORM(frame, RAW_RFL1_I);
+    chain1->rflQ = RAW_WAVEFORM(frame, RAW_RFL1_Q);
+    chain1->fwdScale = fwd1_k * pow(10, 1.0 * fwd1_b / 10) / 1000;
+    chain1->rflScale = rfl1_k * pow(10, 1.0 * rfl1_b / 10) / 1000;
+    chain1->fwdAmp = frame->output[WF_FWD1_AMP];
+    chain1->fwdPhase = frame->output[WF_FWD1_PHASE];
+    chain1->fwdPower = frame->output[WF_FWD1_POWER];
+    chain1->rflAmp = frame->output[WF_RFL1_AMP];
+    chain1->rflPhase = frame->output[WF_RFL1_PHASE];
+    chain1->rflPower = frame->output[WF_RFL1_POWER];
+    chain1->vswr = frame->output[WF_CAV_VSWR1];
+
+    DSP_RF_CHAIN *chain2 = &frame->dsp.chain[1];
+    chain2->fwdI = RAW_WAVEFORM(frame, RAW_FWD2_I);
+    chain2->fwdQ = RAW_WAVEFORM(frame, RAW_FWD2_Q);
+    chain2->rflI = RAW_WAVEFORM(frame, RAW_RFL2_I);
+    chain2->rflQ = RAW_WAVEFORM(frame, RAW_RFL2_Q);
+    chain2->fwdScale = fwd2_k * pow(10, 1.0 * fwd2_b / 10) / 1000;
+    chain2->rflScale = rfl2_k * pow(10, 1.0 * rfl2_b / 10) / 1000;
+    chain2->fwdAmp = frame->output[WF_FWD2_AMP];
+    chain2->fwdPhase = frame->output[WF_FWD2_PHASE];
+    chain2->fwdPower = frame->output[WF_FWD2_POWER];
+    chain2->rflAmp = frame->output[WF_RFL2_AMP];
+    chain2->rflPhase = frame->output[WF_RFL2_PHASE];
+    chain2->rflPower = frame->output[WF_RFL2_POWER];
+    chain2->vswr = frame->output[WF_CAV_VSWR2];
+
+    frame->dsp.phaseScale = 180 / PI;
+    frame->dsp.phaseMode = DSP_PHASE_ACCURATE;
+    frame->float32Mask = 0;
+    frame->roiStart = 0;
+    frame->roiEnd = WAVEFORM_POINT;
+    frame->decimationFactor = DECIMATION_OFF;
+    frame->decimatedLength = 0;
+    frame->position = 0;
+    frame->changedMask = GROUP_ALL;
+    frame->outputMask = (1 << WF_OUTPUT_NUMBER) - 1;
+    frame->channelMask = CHANNEL_ALL;
+    frame->statsStart = 0;
+    frame->statsEnd = WAVEFORM_POINT;
+    frame->spectrumMask = 0;
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        frame->probeCount[i] = 0;
+    }
+    frame->dsp.chain[0].outputs = DSP_CHAIN_ALL;
+    frame->dsp.chain[1].outputs = DSP_CHAIN_ALL;
+    frame->dsp.sums = 1;
+    frame->dsp.inPower = frame->output[WF_CAV_INPOWER];
+    frame->dsp.fwdPower = frame->output[WF_CAV_FWDPOWER];
+    frame->dsp.rflPower = frame->output[WF_CAV_RFLPOWER];
+}
+
+
+void cpciLLRF::workerThread(PROCESS_WORKER *worker)
+{
+    while(1) {
+        epicsEventMustWait(worker->startEvent);
+        processBlock(worker->frame, worker->start, worker->end, worker->stats);
+        epicsEventSignal(worker->doneEvent);
+    }
+}
+
+
+/* Convert the points [start, end) of all the waveforms, and accumulate the statistics of its window points */
+void cpciLLRF::processBlock(LLRF_FRAME *frame, int start, int end, DSP_STATS *stats)
+{
+    int statsStart = (start > frame->statsStart) ? start : frame->statsStart;
+    int statsEnd = (end < frame->statsEnd) ? end : frame->statsEnd;
+
+    // Amplitude, phase, power and VSWR of both RF chains and the cavity sums in one pass
+    if(frame->changedMask & (1 << GROUP_RF_CHAINS)) {
+        dspConvertFrame(&frame->dsp, start, end);
+    }
+
+    for(size_t i=0; i<sizeof(scaledOutputs) / sizeof(scaledOutputs[0]); i++) {
+        if(outputConverted(frame, scaledOutputs[i].output)) {
+            dspScale(RAW_WAVEFORM(frame, scaledOutputs[i].raw), scaledOutputs[i].scale,
+                     frame->output[scaledOutputs[i].output], start, end);
+        }
+    }
+
+    // Float32 copies while the block is in cache
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        if((frame->float32Mask & (1 << i)) && outputConverted(frame, i)) {
+            dspNarrow(frame->output[i], frame->output32[i], start, end);
+        }
+    }
+
+    // Statistics in the same pass
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        dspStatsReset(&stats[i]);
+        if(outputConverted(frame, i)) {
+            dspStatsAdd(&stats[i], frame->output[i], statsStart, statsEnd, (PHASE_OUTPUTS & (1 << i)) != 0);
+        }
+    }
+}
+
+
+/* Block boundary k of the region of interest, at a multiple of 64 points clamped to [roiStart, roiEnd) */
+static int blockBoundary(const LLRF_FRAME *frame, int base, int blockSize, int k)
+{
+    int boundary = base + k * blockSize;
+
+    if(boundary < frame->roiStart) return frame->roiStart;
+    if(boundary > frame->roiEnd) return frame->roiEnd;
+    return boundary;
+}
+
+
+/* Split the region of interest into blocks of whole cache lines, one per thread, and join before publication.
+ * The boundaries are at multiples of 64 points of the waveforms, so that no two threads write into the same
+ * cache line of output or output32 whatever roiStart is */
+void cpciLLRF::processFrame(LLRF_FRAME *frame)
+{
+    int base = frame->roiStart & ~63;
+    int length = frame->roiEnd - base;
+    int blockSize = ((length + workerCount - 1) / workerCount + 63) & ~63;
+    int i;
+
+    for(i=1; i<workerCount; i++) {
+        workers[i].frame = frame;
+        workers[i].start = blockBoundary(frame, base, blockSize, i);
+        workers[i].end = blockBoundary(frame, base, blockSize, i + 1);
+        epicsEventSignal(workers[i].startEvent);
+    }
+
+    processBlock(frame, frame->roiStart, blockBoundary(frame, base, blockSize, 1), workers[0].stats);
+
+    for(i=1; i<workerCount; i++) {
+        epicsEventMustWait(workers[i].doneEvent);
+    }
+
+    // Statistics of the whole window
+    for(int output=0; output<WF_OUTPUT_NUMBER; output++) {
+        frame->stats[output] = workers[0].stats[output];
+        for(i=1; i<workerCount; i++) {
+            dspStatsMerge(&frame->stats[output], &workers[i].stats[output]);
+        }
+    }
+}
+
+
+/* Values of the probe sets: the mean of width points centered on each position, circular for a phase,
+ * NaN when no point is in the region of interest or the output is not computed */
+void cpciLLRF::probeFrame(LLRF_FRAME *frame, const PROBE_SET *probes)
+{
+    DSP_STATS stats;
+    int start, end;
+
+    for(int s=0; s<PROBE_SET_NUMBER; s++) {
+        const PROBE_SET *set = &probes[s];
+        frame->probeCount[s] = set->count;
+        if(set->count == 0) continue;
+
+        for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+            epicsFloat64 *values = probeValues[s] + i * PROBE_POINT_MAX;
+            // Slots past the positions in use hold no value, e.g. after the set has shrunk
+            for(int p=set->count; p<PROBE_POINT_MAX; p++) values[p] = NAN;
+            if(!(frame->outputMask & (1 << i))) {
+                for(int p=0; p<set->count; p++) values[p] = NAN;
+                continue;
+            }
+            // The values of an unchanged group are still those of its last conversion
+            if(!outputConverted(frame, i)) continue;
+            for(int p=0; p<set->count; p++) {
+                start = set->positions[p] - (set->width - 1) / 2;
+                end = start + set->width;
+                if(start < frame->roiStart) start = frame->roiStart;
+                if(end > frame->roiEnd) end = frame->roiEnd;
+                dspStatsReset(&stats);
+                dspStatsAdd(&stats, frame->output[i], start, end, (PHASE_OUTPUTS & (1 << i)) != 0);
+                values[p] = (stats.count > 0) ? dspStatsMean(&stats, (PHASE_OUTPUTS & (1 << i)) != 0) : NAN;
+            }
+        }
+        memcpy(frame->probeValues[s], probeValues[s], sizeof(probeValues[s]));
+    }
+}
+
+
+/* Multi-frame averaging of the raw channels read, the average replaces the raw waveforms of one frame
+ * in average_count, false for the other frames which are only accumulated */
+bool cpciLLRF::averageFrame(LLRF_FRAME *frame, int mode, int count, double alpha)
+{
+    short *raw;
+    int i;
+
+    if(mode != average.mode || count != average.count || alpha != average.alpha || frame->channelMask != average.channelMask) {
+        average.mode = mode;
+        average.count = count;
+        average.alpha = alpha;
+        average.channelMask = frame->channelMask;
+        average.frames = 0;
+        average.started = false;
+        memset(average.sum, 0, WAVEFORM_NUMBER*WAVEFORM_POINT*sizeof(int));
+    }
+    if(mode == AVERAGE_OFF) return true;
+
+    // The exponential average starts from the first frame
+    for(i=0; i<WAVEFORM_NUMBER; i++) {
+        if(!(frame->channelMask & (1 << i))) continue;
+        if(mode == AVERAGE_BOXCAR) {
+            dspAccumulate(RAW_WAVEFORM(frame, i), average.sum + i*WAVEFORM_POINT, WAVEFORM_POINT);
+        } else {
+            dspEma(RAW_WAVEFORM(frame, i), average.started ? (float)alpha : 1.0f, average.acc + i*WAVEFORM_POINT, WAVEFORM_POINT);
+        }
+    }
+    average.started = true;
+    if(++average.frames < count) return false;
+
+    for(i=0; i<WAVEFORM_NUMBER; i++) {
+        if(!(frame->channelMask & (1 << i))) continue;
+        raw = RAW_WAVEFORM(frame, i);
+        if(mode == AVERAGE_BOXCAR) {
+            dspAverage(average.sum + i*WAVEFORM_POINT, count, raw, WAVEFORM_POINT);
+        } else {
+            dspRound(average.acc + i*WAVEFORM_POINT, raw, WAVEFORM_POINT);
+        }
+    }
+    if(mode == AVERAGE_BOXCAR) {
+        memset(average.sum, 0, WAVEFORM_NUMBER*WAVEFORM_POINT*sizeof(int));
+    }
+    average.frames = 0;
+    return true;
+}
+
+
+/* Processing stage: convert each acquired frame and pass it to the publication */
+void cpciLLRF::processThread(void)
+{
+    LLRF_FRAME *frame;
+    int phaseMode;
+    int float32Mask;
+    int roiMode;
+    int roiStart;
+    int roiEnd;
+    int decimationFactor;
+    int position;
+    int outputs;
+    int statsStart;
+    int statsEnd;
+    int spectrumMask;
+    int spectrumWindow;
+    PROBE_SET probes[PROBE_SET_NUMBER];
+    int probeVersion;
+    int averageMode;
+    int averageCount;
+    double averageAlpha;
+    unsigned long long hash;
+    int i;
+
+    while(1) {
+        epicsMessageQueueReceive(processQueue, &frame, sizeof(LLRF_FRAME *));
+
+        lock();
+
+        // Only the outputs someone listens to are computed, with the chain outputs they depend on,
+        // an output with a channel not read is left out. The lock covers the probe sets in use
+        outputs = subscribedOutputs();
+        for(i=0; i<WF_OUTPUT_NUMBER; i++) {
+            if(outputChannels[i] & ~frame->channelMask) outputs &= ~(1 << i);
+        }
+
+        getIntegerParam(_phase_mode, &phaseMode);
+        getIntegerParam(_float32_mask, &float32Mask);
+        getIntegerParam(_spectrum_mask, &spectrumMask);
+        getIntegerParam(_spectrum_window, &spectrumWindow);
+        memcpy(probes, probeSets, sizeof(probes));
+        probeVersion = this->probeVersion;
+        getIntegerParam(_decimation_factor, &decimationFactor);
+        getIntegerParam(_waveform_single_point_position, &position);
+        getIntegerParam(_stats_start, &statsStart);
+        getIntegerParam(_stats_length, &statsEnd);
+        statsEnd += statsStart;
+        getIntegerParam(_average_mode, &averageMode);
+        getIntegerParam(_average_count, &averageCount);
+        getDoubleParam(_average_alpha, &averageAlpha);
+        getIntegerParam(_roi_mode, &roiMode);
+        if(roiMode == ROI_MODE_FREQ_CAL) {
+            // The end point of the frequency calculation is included
+            getIntegerParam(startCntReason, &roiStart);
+            getIntegerParam(endCntReason, &roiEnd);
+            roiEnd++;
+        } else {
+            getIntegerParam(_roi_start, &roiStart);
+            getIntegerParam(_roi_length, &roiEnd);
+            roiEnd += roiStart;
+        }
+        unlock();
+
+        // An averaged frame is converted once its average is complete
+        if(!averageFrame(frame, averageMode, averageCount, averageAlpha)) {
+            epicsMessageQueueSend(freeQueue, &frame, sizeof(LLRF_FRAME *));
+            continue;
+        }
+
+        // Keep at least one point inside the frame, the register settings are not checked
+        if(roiStart < 0) roiStart = 0;
+        if(roiStart > WAVEFORM_POINT - 1) roiStart = WAVEFORM_POINT - 1;
+        if(roiEnd > WAVEFORM_POINT) roiEnd = WAVEFORM_POINT;
+        if(roiEnd <= roiStart) roiEnd = roiStart + 1;
+        frame->roiStart = roiStart;
+        frame->roiEnd = roiEnd;
+
+        // The frame is private to this stage, the conversion runs without the lock
+        frame->dsp.phaseMode = phaseMode;
+        frame->float32Mask = float32Mask;
+        frame->decimationFactor = decimationFactor;
+        frame->position = position;
+        frame->statsStart = statsStart;
+        frame->statsEnd = statsEnd;
+        frame->outputMask = outputs;
+        frame->dsp.chain[0].outputs = ((outputs & CHAIN1_MAGNITUDE_OUTPUTS) ? DSP_CHAIN_MAGNITUDE : 0) |
+                                      ((outputs & (1 << WF_FWD1_PHASE)) ? DSP_CHAIN_FWD_PHASE : 0) |
+                                      ((outputs & (1 << WF_RFL1_PHASE)) ? DSP_CHAIN_RFL_PHASE : 0);
+        frame->dsp.chain[1].outputs = ((outputs & CHAIN2_MAGNITUDE_OUTPUTS) ? DSP_CHAIN_MAGNITUDE : 0) |
+                                      ((outputs & (1 << WF_FWD2_PHASE)) ? DSP_CHAIN_FWD_PHASE : 0) |
+                                      ((outputs & (1 << WF_RFL2_PHASE)) ? DSP_CHAIN_RFL_PHASE : 0);
+        frame->dsp.sums = (outputs & SUM_OUTPUTS) != 0;
+
+        // Only the groups whose raw channels changed since the previous frame are converted and published,
+        // the buffers of the other groups are stale, a change of the settings takes all of them
+        frame->changedMask = 0;
+        for(i=0; i<WAVEFORM_NUMBER; i++) {
+            if(!(frame->channelMask & (1 << i))) continue;
+            hash = dspHash(RAW_WAVEFORM(frame, i), WAVEFORM_POINT);
+            if(hash != rawHashes[i]) {
+                rawHashes[i] = hash;
+                frame->changedMask |= 1 << rawGroups[i];
+            }
+        }
+        if(phaseMode != lastSettings.phaseMode || float32Mask != lastSettings.float32Mask ||
+           roiStart != lastSettings.roiStart || roiEnd != lastSettings.roiEnd ||
+           decimationFactor != lastSettings.decimationFactor || position != lastSettings.position ||
+           outputs != lastSettings.outputs || statsStart != lastSettings.statsStart || statsEnd != lastSettings.statsEnd ||
+           spectrumMask != lastSettings.spectrumMask || spectrumWindow != lastSettings.spectrumWindow ||
+           probeVersion != lastSettings.probeVersion) {
+            frame->changedMask = GROUP_ALL;
+            lastSettings.phaseMode = phaseMode;
+            lastSettings.float32Mask = float32Mask;
+            lastSettings.roiStart = roiStart;
+            lastSettings.roiEnd = roiEnd;
+            lastSettings.decimationFactor = decimationFactor;
+            lastSettings.position = position;
+            lastSettings.outputs = outputs;
+            lastSettings.statsStart = statsStart;
+            lastSettings.statsEnd = statsEnd;
+            lastSettings.spectrumMask = spectrumMask;
+            lastSettings.spectrumWindow = spectrumWindow;
+            lastSettings.probeVersion = probeVersion;
+        }
+        if(frame->changedMask != 0 && outputs != 0) {
+            processFrame(frame);
+        }
+
+        // Min/max decimation of the region of interest for the display clients
+        if(decimationFactor > DECIMATION_OFF) {
+            for(i=0; i<WF_OUTPUT_NUMBER; i++) {
+                if(!outputConverted(frame, i)) continue;
+                frame->decimatedLength = dspMinMax(frame->output[i] + roiStart, roiEnd - roiStart,
+                                                   decimationFactor, frame->decimated[i]);
+            }
+        }
+
+        probeFrame(frame, probes);
+
+        // Amplitude spectrum of the region of interest, zero padded to WAVEFORM_POINT
+        frame->spectrumMask = 0;
+        for(i=0; i<WF_OUTPUT_NUMBER && fftPlan != NULL; i++) {
+            if(!(spectrumMask & (1 << i)) || !outputConverted(frame, i)) continue;
+            fftAmplitude(fftPlan, frame->output[i] + roiStart, roiEnd - roiStart, spectrumWindow, frame->spectrum[i]);
+            frame->spectrumMask |= 1 << i;
+        }
+
+        epicsMessageQueueSend(publishQueue, &frame, sizeof(LLRF_FRAME *));
+    }
+}
+
+
+/* Publication stage: do the callbacks of each converted frame and give the frame back to the acquisition,
+ * the lock is held only for the callbacks and the frame is not reused before they return */
+void cpciLLRF::publishThread(void)
+{
+    LLRF_FRAME *frame;
+    int position;
+    int start;
+    int length;
+    int i;
+
+    while(1) {
+        epicsMessageQueueReceive(publishQueue, &frame, sizeof(LLRF_FRAME *));
+
+        // Only the region of interest of the changed groups is published
+        start = frame->roiStart;
+        length = frame->roiEnd - frame->roiStart;
+        if(frame->changedMask == 0) {
+            epicsMessageQueueSend(freeQueue, &frame, sizeof(LLRF_FRAME *));
+            continue;
+        }
+
+        lock();
+        for(i=0; i<WF_OUTPUT_NUMBER; i++) {
+            if(!outputConverted(frame, i)) continue;
+            // An output selected by float32_mask is published as Float32 instead of Float64
+            if(frame->float32Mask & (1 << i)) {
+                doCallbacksFloat32Array(frame->output32[i] + start, length, _waveform_f32[i], 0);
+            } else {
+                doCallbacksFloat64Array(frame->output[i] + start, length, _waveform[i], 0);
+            }
+            if(frame->decimationFactor > DECIMATION_OFF) {
+                doCallbacksFloat64Array(frame->decimated[i], frame->decimatedLength, _waveform_dec[i], 0);
+            }
+            if(frame->spectrumMask & (1 << i)) {
+                doCallbacksFloat64Array(frame->spectrum[i], SPECTRUM_POINT, _spectrum[i], 0);
+            }
+        }
+        for(i=0; i<WAVEFORM_NUMBER; i++) {
+            if(!(frame->channelMask & (1 << i)) || !(frame->changedMask & (1 << rawGroups[i]))) continue;
+            doCallbacksInt16Array(RAW_WAVEFORM(frame, i) + start, length, _waveform_raw[i], 0);
+        }
+
+        /**** Probe sets, all the outputs in one array per set ****/
+        for(i=0; i<PROBE_SET_NUMBER; i++) {
+            if(frame->probeCount[i] == 0) continue;
+            doCallbacksFloat64Array(frame->probeValues[i], PROBE_VALUE_NUMBER, _probe_values[i], 0);
+        }
+
+        /**** Position of the frame, it is the index in the whole frame ****/
+        position = frame->position;
+
+        if(position >= frame->roiStart && position < frame->roiEnd) {
+            /**** Set waveform single point value for the specified position ****/
+            for(i=0; i<WF_OUTPUT_NUMBER; i++) {
+                if(!outputConverted(frame, i)) continue;
+                setDoubleParam(_waveform_single_point[i], frame->output[i][position]);
+            }
+        }
+
+        /**** Window statistics ****/
+        for(i=0; i<WF_OUTPUT_NUMBER; i++) {
+            if(!outputConverted(frame, i) || frame->stats[i].count == 0) continue;
+            setDoubleParam(_stats_min[i], frame->stats[i].min);
+            setDoubleParam(_stats_max[i], frame->stats[i].max);
+            setDoubleParam(_stats_mean[i], dspStatsMean(&frame->stats[i], (PHASE_OUTPUTS & (1 << i)) != 0));
+            setDoubleParam(_stats_rms[i], dspStatsRms(&frame->stats[i]));
+        }
+
+        /**** Pulse-to-pulse stability, one value per output and frame ****/
+        if(stabilityReset) {
+            int window;
+            getIntegerParam(_stability_window, &window);
+            for(i=0; i<STAB_OUTPUT_NUMBER; i++) {
+                dspStabilityReset(&stability[i], window);
+            }
+            stabilityReset = false;
+        }
+        for(i=0; i<STAB_OUTPUT_NUMBER; i++) {
+            int output = stabilityOutputs[i];
+            bool phase = (PHASE_OUTPUTS & (1 << output)) != 0;
+            double std;
+            if(!outputConverted(frame, output) || frame->stats[output].count == 0) continue;
+            dspStabilityAdd(&stability[i], dspStatsMean(&frame->stats[output], phase), phase);
+            std = dspStabilityStd(&stability[i]);
+            if(phase) {
+                setDoubleParam(_stability_mean[i], remainder(stability[i].mean, 360));
+                setDoubleParam(_stability[i], std);
+            } else {
+                setDoubleParam(_stability_mean[i], stability[i].mean);
+                setDoubleParam(_stability[i], (stability[i].mean != 0) ? 100 * std / fabs(stability[i].mean) : 0);
+            }
+        }
+
+        callParamCallbacks();
+        unlock();
+
+        epicsMessageQueueSend(freeQueue, &frame, sizeof(LLRF_FRAME *));
+    }
+}
+
+
+/* Mask of the WAVEFORM_OUTPUTs a parameter is computed from, 0 if it is not computed from the outputs.
+ * A probe set counts only while it has positions, it is called with the lock held */
+int cpciLLRF::outputsOfReason(int reason)
+{
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        if(reason == _probe_values[i]) {
+            return (probeSets[i].count > 0) ? (1 << WF_OUTPUT_NUMBER) - 1 : 0;
+        }
+    }
+    for(int i=0; i<WF_OUTPUT_NUMBER; i++) {
+        if(reason == _waveform[i] || reason == _waveform_f32[i] || reason == _waveform_dec[i] || reason == _spectrum[i] ||
+           reason == _waveform_single_point[i] || reason == _stats_min[i] || reason == _stats_max[i] ||
+           reason == _stats_mean[i] || reason == _stats_rms[i]) {
+            return 1 << i;
+        }
+    }
+    for(int i=0; i<STAB_OUTPUT_NUMBER; i++) {
+        if(reason == _stability_mean[i] || reason == _stability[i]) {
+            return 1 << stabilityOutputs[i];
+        }
+    }
+    return 0;
+}
+
+
+/* Outputs with an interrupt client on one interface */
+template <class INTERRUPT>
+static int interruptOutputs(cpciLLRF *driver, void *interruptPvt)
+{
+    ELLLIST *pclientList;
+    interruptNode *pnode;
+    int outputs = 0;
+
+    pasynManager->interruptStart(interruptPvt, &pclientList);
+    for(pnode = (interruptNode *)ellFirst(pclientList); pnode != NULL; pnode = (interruptNode *)ellNext(&pnode->node)) {
+        outputs |= driver->outputsOfReason(((INTERRUPT *)pnode->drvPvt)->pasynUser->reason);
+    }
+    pasynManager->interruptEnd(interruptPvt);
+    return outputs;
+}
+
+
+/* Outputs with an interrupt client on one of the records of cpciLLRFOutput.template or cpciLLRFStability.template,
+ * or on a probe set in use. An IOC leaves an output uncomputed by not loading its records */
+int cpciLLRF::subscribedOutputs(void)
+{
+    return interruptOutputs<asynFloat64ArrayInterrupt>(this, asynStdInterfaces.float64ArrayInterruptPvt) |
+           interruptOutputs<asynFloat32ArrayInterrupt>(this, asynStdInterfaces.float32ArrayInterruptPvt) |
+           interruptOutputs<asynFloat64Interrupt>(this, asynStdInterfaces.float64InterruptPvt);
+}
+
+
+/* End of the pulse of a pulse register, reset it to 0 */
+void cpciLLRF::pulseExpired(REG_PULSE *pulse)
+{
+    PCI_REG_INFO *reg = &registers[pulse->index];
+    epicsTimeStamp now;
+    int status;
+
+    lock();
+
+    // A write of 0, or of a new pulse while this expiry waited for the lock, leaves the register as it is,
+    // the timer of a new pulse has been restarted and expires at the new deadline
+    epicsTimeGetCurrent(&now);
+    if(!pulse->armed || epicsTimeDiffInSeconds(&pulse->deadline, &now) > reg->pulseWidth / 2) {
+        unlock();
+        return;
+    }
+    pulse->armed = false;
+
+    status = uint32Write(fd, reg->offset, 0);
+    if(status == 0) {
+        setIntegerParam(firstRegParam + pulse->index, 0);
+        callParamCallbacks();
+    } else {
+        printf("pulseExpired(): uint32Write of %s return error\n", reg->name);
+    }
+    unlock();
+}
+
+
+/* Read all the registers in one batch and publish the readbacks with one callback pass */
+void cpciLLRF::refreshRegisters(void)
+{
+    epicsInt32 regData;
+    int i;
+
+    if(!regParamsValid) return;
+    if(regBatchRead(fd, regSnapshot, regCount) != 0) {
+        printf("refreshRegisters(): regBatchRead return error\n");
+        return;
+    }
+
+    lock();
+    for(i=0; i<regCount; i++) {
+        regData = (epicsInt32)regSnapshot[i].value;
+        if(registers[i].type == asynParamFloat64) {
+            setDoubleParam(firstRegParam + i, regToParam(registers[i].conv, regData));
+        } else {
+            setIntegerParam(firstRegParam + i, (epicsInt32)regToParam(registers[i].conv, regData));
+        }
+    }
+    callParamCallbacks();
+    unlock();
+}
+
+
 void cpciLLRF::pollerThread(void)
 {
     epicsUInt32 wfReady = 0;
-    const epicsUInt32 offset = 508;
+    IO_EVENT event;
+    epicsTimeStamp now;
+    LLRF_FRAME *frame;
+    int channelMask;
+    int first;
+    int last;
+    epicsUInt32 offset;
+    int length;
     int status;
-    int position;
 
     /* Loop forever */
     while(1) {
-        epicsThreadSleep(POLLING_PERIOD_IN_SECOND);
-
-        #ifdef false
-        // Read the wavefrom ready flag
-        status = uint32Read(fd, offset, &wfReady);
-        if(status != 0) {
-            printf("pollerThread(): uint32Read return error");
-            return;
+        // Refresh the register readbacks, the records are I/O Intr
+        epicsTimeGetCurrent(&now);
+        if(epicsTimeDiffInSeconds(&now, &lastRefresh) >= REGISTER_REFRESH_PERIOD_IN_SECOND) {
+            refreshRegisters();
+            lastRefresh = now;
         }
-        
-        printf("**************************\n");
-        printf("wfReady 0: %d\n", wfReady);
 
-        if(!wfReady) continue;
+        if(useIrq) {
+            // Wait for the FPGA to signal a new waveform block. The driver having an interrupt does not mean
+            // the FPGA raises it: without interrupt for a polling period the frame is read as in polling mode
+            status = eventWait(fd, (int)(POLLING_PERIOD_IN_SECOND * 1000));
+            if(status == EVENT_TIMEOUT) {
+                irqTimeouts++;
+                lock();
+                setIntegerParam(_irq_timeouts, irqTimeouts);
+                callParamCallbacks();
+                unlock();
+            } else {
+                if(status != 0) {
+                    printf("pollerThread(): eventWait return error");
+                    return;
+                }
+
+                // Read the wavefrom ready flag
+                status = uint32Read(fd, WAVEFORM_READY_OFFSET, &wfReady);
+                if(status != 0) {
+                    printf("pollerThread(): uint32Read return error");
+                    return;
+                }
+
+                // Clear the wavefrom ready flag, then re-arm the interrupt for the next frame
+                if(wfReady) {
+                    status = uint32Write(fd, WAVEFORM_READY_OFFSET, 0);
+                    if(status != 0) {
+                        printf("pollerThread(): uint32Write return error");
+                        return;
+                    }
+                }
+                status = eventAck(fd, &event);
+                if(status != 0) {
+                    printf("pollerThread(): eventAck return error");
+                    return;
+                }
+                if(event.missed > 0) {
+                    printf("pollerThread(): %u waveform ready events missed\n", event.missed);
+                }
+
+                // An interrupt without the ready flag reads nothing, unless no frame was read for a polling period
+                epicsTimeGetCurrent(&now);
+                if(!wfReady && epicsTimeDiffInSeconds(&now, &lastRead) < POLLING_PERIOD_IN_SECOND) continue;
+            }
+        } else {
+            epicsThreadSleep(POLLING_PERIOD_IN_SECOND);
+        }
 
-        /**** Waveform data in FPGA is ready ****/
+        epicsTimeGetCurrent(&lastRead);
 
-        // Clear the wavefrom ready flag
-        status = uint32Write(fd, offset, 0);
-        if(status != 0) {
-            printf("pollerThread(): uint32Write return error");
-            return;
-        }
-        
-        epicsUInt32 wfReady1;
-        status = uint32Read(fd, offset, &wfReady1);
-        if(status != 0) {
-            printf("pollerThread(): uint32Read return error");
-            return;
+        // Take a free frame buffer, the frame is dropped if the processing and publication hold all of them
+        if(epicsMessageQueueTryReceive(freeQueue, &frame, sizeof(LLRF_FRAME *)) != sizeof(LLRF_FRAME *)) {
+            // Counted in a parameter, frames drop at pulse rate and a message for each one would flood the console
+            droppedFrames++;
+            lock();
+            setIntegerParam(_dropped_frames, droppedFrames);
+            callParamCallbacks();
+            unlock();
+            continue;
         }
-        printf("wfReady 1: %d\n", wfReady1);
-        printf("**************************\n");
-        #endif
 
         //struct timespec start, end;
 	    //double time_spent;
 	    //const int BILLION = 1000000000;
         //clock_gettime(CLOCK_REALTIME, &start);
         
-        // Read waveform raw data from FPGA
-        status = waveformRead(fd, WAVEFORM_OFFSET, WAVEFORM_LENGTH, (char *)waveformBuffer);
+        // Read the enabled channels of waveform raw data from FPGA, adjacent channels in one transfer
+        lock();
+        getIntegerParam(_channel_mask, &channelMask);
+        unlock();
+        frame->channelMask = channelMask;
+        status = 0;
+        for(first=0; first<WAVEFORM_NUMBER && status == 0; first=last) {
+            last = first + 1;
+            if(!(channelMask & (1 << first))) continue;
+            while(last < WAVEFORM_NUMBER && (channelMask & (1 << last))) last++;
+
+            offset = WAVEFORM_OFFSET + first * WAVEFORM_POINT * WAVEFORM_DATA_BYTE;
+            length = (last - first) * WAVEFORM_POINT * WAVEFORM_DATA_BYTE;
+            if(useDma) {
+                status = waveformDmaRead(fd, offset, length, (char *)RAW_WAVEFORM(frame, first));
+            } else {
+                status = waveformBulkRead(fd, offset, length, (char *)RAW_WAVEFORM(frame, first));
+            }
+        }
         if(status != 0) {
-            printf("pollerThread(): waveformRead return error");
+            printf("pollerThread(): waveform read return error");
             return;
         }   
-          
-        for(int i = 0; i < WAVEFORM_POINT; i++) {
-            waveform_CAV2_amp[i] = 1.0 * waveform_0[i];
-            waveform_CAV2_phase[i] = 1.0 * waveform_1[i] / 32768 * 180;
-            waveform_CAV1_amp[i] = 1.0 * waveform_2[i];
-            waveform_CAV1_phase[i] = 1.0 * waveform_3[i] / 32768 * 180;
-
-            waveform_fwd1_amp[i] = 1.0 * sqrt(pow(waveform_4[i], 2) + pow(waveform_5[i], 2));
-            waveform_fwd1_phase[i] = 1.0 * atan2((double)waveform_5[i], (double)waveform_4[i]) * 180 / PI;
-            waveform_fwd1_power[i] = 1.0 * (pow(waveform_4[i], 2) + pow(waveform_5[i], 2)) * fwd1_k * pow(10, 1.0 * fwd1_b / 10) / 1000;
-            waveform_rfl1_amp[i] = 1.0 * sqrt(pow(waveform_6[i], 2) + pow(waveform_7[i], 2));;
-            waveform_rfl1_phase[i] = 1.0 * atan2((double)waveform_7[i], (double)waveform_6[i]) * 180 / PI;
-            waveform_rfl1_power[i] = 1.0 * (pow(waveform_6[i], 2) + pow(waveform_7[i], 2)) * rfl1_k * pow(10, 1.0 * rfl1_b / 10) / 1000;
-            waveform_CAV_VSWR1[i] = 1.0 * (sqrt(waveform_fwd1_power[i]) + sqrt(waveform_rfl1_power[i])) / (sqrt(waveform_fwd1_power[i]) - sqrt(waveform_rfl1_power[i]));
-
-            waveform_fwd2_amp[i] = 1.0 * sqrt(pow(waveform_8[i], 2) + pow(waveform_9[i], 2));
-            waveform_fwd2_phase[i] = 1.0 * atan2((double)waveform_9[i], (double)waveform_8[i]) * 180 / PI;
-            waveform_fwd2_power[i] = 1.0 * (pow(waveform_8[i], 2) + pow(waveform_9[i], 2)) * fwd2_k * pow(10, 1.0 * fwd2_b / 10) / 1000;
-            waveform_rfl2_amp[i] = 1.0 * sqrt(pow(waveform_10[i], 2) + pow(waveform_11[i], 2));;
-            waveform_rfl2_phase[i] = 1.0 * atan2((double)waveform_11[i], (double)waveform_10[i]) * 180 / PI;
-            waveform_rfl2_power[i] = 1.0 * (pow(waveform_10[i], 2) + pow(waveform_11[i], 2)) * rfl2_k * pow(10, 1.0 * rfl2_b / 10) / 1000;
-            waveform_CAV_VSWR2[i] = 1.0 * (sqrt(waveform_fwd2_power[i]) + sqrt(waveform_rfl2_power[i])) / (sqrt(waveform_fwd2_power[i]) - sqrt(waveform_rfl2_power[i]));
-
-            waveform_CAV_inpower[i] = waveform_fwd1_power[i] + waveform_fwd2_power[i] - waveform_rfl1_power[i] - waveform_rfl2_power[i];
-            waveform_CAV_fwdpower[i] = waveform_fwd1_power[i] + waveform_fwd2_power[i];
-            waveform_CAV_rflpower[i] = waveform_rfl1_power[i] + waveform_rfl2_power[i];
-            
-            waveform_DAC_amp[i] = 1.0 * waveform_12[i];;
-            waveform_DAC_phase[i] = 1.0 * waveform_13[i] / 32768 * 180;
-        }  
-
-        doCallbacksFloat64Array(waveform_CAV2_amp, WAVEFORM_POINT, _waveform_CAV2_amp, 0);
-        doCallbacksFloat64Array(waveform_CAV2_phase, WAVEFORM_POINT, _waveform_CAV2_phase, 0);
-        doCallbacksFloat64Array(waveform_CAV1_amp, WAVEFORM_POINT, _waveform_CAV1_amp, 0);
-        doCallbacksFloat64Array(waveform_CAV1_phase, WAVEFORM_POINT, _waveform_CAV1_phase, 0);
-
-        doCallbacksFloat64Array(waveform_fwd1_amp, WAVEFORM_POINT, _waveform_fwd1_amp, 0);
-        doCallbacksFloat64Array(waveform_fwd1_phase, WAVEFORM_POINT, _waveform_fwd1_phase, 0);
-        doCallbacksFloat64Array(waveform_fwd1_power, WAVEFORM_POINT, _waveform_fwd1_power, 0);
-        doCallbacksFloat64Array(waveform_rfl1_amp, WAVEFORM_POINT, _waveform_rfl1_amp, 0);
-        doCallbacksFloat64Array(waveform_rfl1_phase, WAVEFORM_POINT, _waveform_rfl1_phase, 0);
-        doCallbacksFloat64Array(waveform_rfl1_power, WAVEFORM_POINT, _waveform_rfl1_power, 0);
-        doCallbacksFloat64Array(waveform_CAV_VSWR1, WAVEFORM_POINT, _waveform_CAV_VSWR1, 0);
-
-        doCallbacksFloat64Array(waveform_fwd2_amp, WAVEFORM_POINT, _waveform_fwd2_amp, 0);
-        doCallbacksFloat64Array(waveform_fwd2_phase, WAVEFORM_POINT, _waveform_fwd2_phase, 0);
-        doCallbacksFloat64Array(waveform_fwd2_power, WAVEFORM_POINT, _waveform_fwd2_power, 0);
-        doCallbacksFloat64Array(waveform_rfl2_amp, WAVEFORM_POINT, _waveform_rfl2_amp, 0);
-        doCallbacksFloat64Array(waveform_rfl2_phase, WAVEFORM_POINT, _waveform_rfl2_phase, 0);
-        doCallbacksFloat64Array(waveform_rfl2_power, WAVEFORM_POINT, _waveform_rfl2_power, 0);
-        doCallbacksFloat64Array(waveform_CAV_VSWR2, WAVEFORM_POINT, _waveform_CAV_VSWR2, 0);
-
-        doCallbacksFloat64Array(waveform_CAV_inpower, WAVEFORM_POINT, _waveform_CAV_inpower, 0);
-        doCallbacksFloat64Array(waveform_CAV_fwdpower, WAVEFORM_POINT, _waveform_CAV_fwdpower, 0);
-        doCallbacksFloat64Array(waveform_CAV_rflpower, WAVEFORM_POINT, _waveform_CAV_rflpower, 0);
-
-        doCallbacksFloat64Array(waveform_DAC_amp, WAVEFORM_POINT, _waveform_DAC_amp, 0);
-        doCallbacksFloat64Array(waveform_DAC_phase, WAVEFORM_POINT, _waveform_DAC_phase, 0);
-
-        /**** Get position from parameter library ****/
-        getIntegerParam(_waveform_single_point_position, &position);
 
-        if(position >= 0 && position < WAVEFORM_POINT) {
-            /**** Set waveform single point value for the specified position ****/
-            setDoubleParam(_waveform_single_point_CAV2_amp, waveform_CAV2_amp[position]);
-            setDoubleParam(_waveform_single_point_CAV2_phase, waveform_CAV2_phase[position]);
-            setDoubleParam(_waveform_single_point_CAV1_amp, waveform_CAV1_amp[position]);
-            setDoubleParam(_waveform_single_point_CAV1_phase, waveform_CAV1_phase[position]);
-
-            setDoubleParam(_waveform_single_point_fwd1_amp, waveform_fwd1_amp[position]);
-            setDoubleParam(_waveform_single_point_fwd1_phase, waveform_fwd1_phase[position]);
-            setDoubleParam(_waveform_single_point_fwd1_power, waveform_fwd1_power[position]);
-            setDoubleParam(_waveform_single_point_rfl1_amp, waveform_rfl1_amp[position]);
-            setDoubleParam(_waveform_single_point_rfl1_phase, waveform_rfl1_phase[position]);
-            setDoubleParam(_waveform_single_point_rfl1_power, waveform_rfl1_power[position]);
-            setDoubleParam(_waveform_single_point_CAV_VSWR1, waveform_CAV_VSWR1[position]);
-
-            setDoubleParam(_waveform_single_point_fwd2_amp, waveform_fwd2_amp[position]);
-            setDoubleParam(_waveform_single_point_fwd2_phase, waveform_fwd2_phase[position]);
-            setDoubleParam(_waveform_single_point_fwd2_power, waveform_fwd2_power[position]);
-            setDoubleParam(_waveform_single_point_rfl2_amp, waveform_rfl2_amp[position]);
-            setDoubleParam(_waveform_single_point_rfl2_phase, waveform_rfl2_phase[position]);
-            setDoubleParam(_waveform_single_point_rfl2_power, waveform_rfl2_power[position]);
-            setDoubleParam(_waveform_single_point_CAV_VSWR2, waveform_CAV_VSWR2[position]);
-
-            setDoubleParam(_waveform_single_point_CAV_inpower, waveform_CAV_inpower[position]);
-            setDoubleParam(_waveform_single_point_CAV_fwdpower, waveform_CAV_fwdpower[position]);
-            setDoubleParam(_waveform_single_point_CAV_rflpower, waveform_CAV_rflpower[position]);
-
-            setDoubleParam(_waveform_single_point_DAC_amp, waveform_DAC_amp[position]);
-            setDoubleParam(_waveform_single_point_DAC_phase, waveform_DAC_phase[position]);
+        // Hand the frame over to the processing, the next read overlaps its conversion and publication
+        epicsMessageQueueSend(processQueue, &frame, sizeof(LLRF_FRAME *));
 
-            callParamCallbacks();
-        }
         //clock_gettime(CLOCK_REALTIME, &end);
         //time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
-        //printf("Waveform read and process: the elapsed time is %f nano seconds\n", time_spent);   
+        //printf("Waveform read: the elapsed time is %f nano seconds\n", time_spent);   
     }
 }
 
@@ -414,50 +1327,35 @@ asynStatus cpciLLRF::readInt32(asynUser *pasynUser, epicsInt32 *value)
     int function = pasynUser->reason;
     int status = 0;
     
-    const char *paramName;
-    epicsUInt32 offset;
+    PCI_REG_INFO *reg;
     epicsInt32 regData;
     epicsInt32 convertedData;
 
-    /* Waveform single point position */
-    if (function == _waveform_single_point_position) {
+    /* Local parameters of the waveform acquisition and processing */
+    if (function == _waveform_single_point_position || function == _phase_mode || function == _float32_mask ||
+        function == _roi_mode || function == _roi_start || function == _roi_length || function == _decimation_factor ||
+        function == _channel_mask || function == _irq_timeouts || function == _dropped_frames ||
+        function == _stats_start || function == _stats_length ||
+        function == _stability_window || function == _stability_reset || function == _average_mode ||
+        function == _average_count || function == _spectrum_mask || function == _spectrum_window) {
         return getIntegerParam(function, value);
     }
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        if(function == _probe_width[i]) return getIntegerParam(function, value);
+    }
     
-    /* Fetch the parameter name */
-    getParamName(function, &paramName);
-    
-    /* Fetch the register offset from the register name */
-    offset = regNameToOffset(paramName);
-    if(offset == INVALID_OFFSET) {
+    /* Fetch the register of the parameter */
+    reg = regInfo(function);
+    if(reg == NULL) {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
-                  "%s:%s: function=%d - register %s is not defined",
-                  driverName, functionName, function, paramName);
+                  "%s:%s: function=%d - register is not defined",
+                  driverName, functionName, function);
         return asynError;
     }
     
-    status = uint32Read(fd, offset, (epicsUInt32 *) &regData);
+    status = uint32Read(fd, reg->offset, (epicsUInt32 *) &regData);
     
-    if(strcmp(paramName, "sp_freq") == 0) {
-        convertedData = 1.0 * regData / pow(2, 32) * 480000000 - 180000000;
-    } else if (strcmp(paramName, "Qset") == 0) {
-        convertedData = 1.0 * regData / 1000;
-    } else if (strcmp(paramName, "powup_time") == 0) {
-        convertedData = 1.0 * regData * 20 * pow(2, 16) / pow(10, 9);
-    } else if (strcmp(paramName, "powdown_time") == 0) {
-        convertedData = 1.0 * regData * 20 * pow(2, 16) / pow(10, 9);
-    } else if (strcmp(paramName, "powup_hold_time") == 0) {
-        convertedData = 1.0 * regData * 20 * pow(2, 16) / pow(10, 9);
-    } else if (strcmp(paramName, "powdown_hold_time") == 0) {
-        convertedData = 1.0 * regData * 20 * pow(2, 16) / pow(10, 9);
-    } else if (strcmp(paramName, "PRT_Start_count") == 0) {
-        convertedData = 1.0 * regData * 6.25 / 1000;
-    } else if (strcmp(paramName, "PRT_End_count") == 0) {
-        convertedData = 1.0 * regData * 6.25 / 1000;
-    } else {
-        //printf("%s    register others\n", functionName);
-        convertedData = regData;
-    }
+    convertedData = regToParam(reg->conv, regData);
     
     *value = convertedData;
     
@@ -477,80 +1375,174 @@ asynStatus cpciLLRF::writeInt32(asynUser *pasynUser, epicsInt32 value)
     int function = pasynUser->reason;
     int status = 0;
     
-    const char *paramName;
-    epicsUInt32 offset;
+    PCI_REG_INFO *reg;
     epicsInt32 regData;
     epicsInt32 convertedData;
 
     /* Waveform single point position */
     if(function == _waveform_single_point_position) {
-        return setIntegerParam(function, value);
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Averaging width of a probe set, takes effect from the next frame */
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        if(function != _probe_width[i]) continue;
+        if(value < 1 || value > PROBE_WIDTH_MAX) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid probe width %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        probeSets[i].width = value;
+        probeVersion++;
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Float32 selection, takes effect from the next frame */
+    if(function == _float32_mask) {
+        if(value & ~((1 << WF_OUTPUT_NUMBER) - 1)) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid Float32 mask 0x%X",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Spectrum selection and window, take effect from the next frame */
+    if(function == _spectrum_mask || function == _spectrum_window) {
+        if((function == _spectrum_mask && (value & ~((1 << WF_OUTPUT_NUMBER) - 1))) ||
+           (function == _spectrum_window && (value < FFT_WINDOW_RECT || value > FFT_WINDOW_BLACKMAN))) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid spectrum setting %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Statistics window, takes effect from the next frame */
+    if(function == _stats_start || function == _stats_length) {
+        if((function == _stats_start && (value < 0 || value >= WAVEFORM_POINT)) ||
+           (function == _stats_length && (value < 1 || value > WAVEFORM_POINT))) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid statistics window setting %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        stabilityReset = true;
+        return callParamCallbacks();
+    }
+
+    /* Stability window in pulses, the stability starts again from the next frame */
+    if(function == _stability_window || function == _stability_reset) {
+        if(function == _stability_window && (value < 0 || value > STABILITY_WINDOW_MAX)) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid stability window %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        if(function == _stability_window) setIntegerParam(function, value);
+        stabilityReset = true;
+        return callParamCallbacks();
+    }
+
+    /* Multi-frame averaging, the average starts again from the next frame */
+    if(function == _average_mode || function == _average_count) {
+        if((function == _average_mode && value != AVERAGE_OFF && value != AVERAGE_BOXCAR && value != AVERAGE_EMA) ||
+           (function == _average_count && (value < 1 || value > AVERAGE_COUNT_MAX))) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid averaging setting %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Readout mask, takes effect from the next frame */
+    if(function == _channel_mask) {
+        if(value & ~CHANNEL_ALL) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid channel mask 0x%X",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Decimation factor, takes effect from the next frame */
+    if(function == _decimation_factor) {
+        if(value < DECIMATION_OFF || value > WAVEFORM_POINT) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid decimation factor %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Region of interest, takes effect from the next frame */
+    if(function == _roi_mode || function == _roi_start || function == _roi_length) {
+        if((function == _roi_mode && value != ROI_MODE_MANUAL && value != ROI_MODE_FREQ_CAL) ||
+           (function == _roi_start && (value < 0 || value >= WAVEFORM_POINT)) ||
+           (function == _roi_length && (value < 1 || value > WAVEFORM_POINT))) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid region of interest setting %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
+    }
+
+    /* Phase computation mode, takes effect from the next frame */
+    if(function == _phase_mode) {
+        if(value != DSP_PHASE_ACCURATE && value != DSP_PHASE_FAST) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid phase mode %d",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setIntegerParam(function, value);
+        return callParamCallbacks();
     }
-    
-    /* Fetch the parameter name */
-    getParamName(function, &paramName);
     
     /* Set the parameter in the parameter library. */
     setIntegerParam(function, value);
 
-    /* Fetch the register offset from the register name */
-    offset = regNameToOffset(paramName);
-    if(offset == INVALID_OFFSET) {
+    /* Fetch the register of the parameter */
+    reg = regInfo(function);
+    if(reg == NULL) {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
-                  "%s:%s: function=%d - register %s is not defined",
-                  driverName, functionName, function, paramName);
+                  "%s:%s: function=%d - register is not defined",
+                  driverName, functionName, function);
         return asynError;
     }
 
-    if(strcmp(paramName, "sp_freq") == 0) {
-        convertedData = 1.0 * (180000000 + value) / 480000000 * pow(2, 32);
-    } else if (strcmp(paramName, "Qset") == 0) {
-        convertedData = value * 1000;
-    } else if (strcmp(paramName, "powup_time") == 0) {
-        convertedData = 1.0 * value * pow(10, 9) / (20 * pow(2, 16));
-    } else if (strcmp(paramName, "powdown_time") == 0) {
-        convertedData = 1.0 * value * pow(10, 9) / (20 * pow(2, 16));
-    } else if (strcmp(paramName, "powup_hold_time") == 0) {
-        convertedData = 1.0 * value * pow(10, 9) / (20 * pow(2, 16));
-    } else if (strcmp(paramName, "powdown_hold_time") == 0) {
-        convertedData = 1.0 * value * pow(10, 9) / (20 * pow(2, 16));
-    } else if (strcmp(paramName, "PRT_Start_count") == 0) {
-        convertedData = 1.0 * value * 1000 / 6.25;
-    } else if (strcmp(paramName, "PRT_End_count") == 0) {
-        convertedData = 1.0 * value * 1000 / 6.25;
-    } else if (strcmp(paramName, "manual_Clear") == 0) {
-    	convertedData = value;
-        struct timespec start, end;
-	    double time_spent;
-        // Manually clear the permanent block
-        if(value == 1) {
-            setIntegerParam(function, 1);
-            status = uint32Write(fd, offset, 1);
-            if(status != 0) return asynError;
-
-			const int BILLION = 1000000000;
-            clock_gettime(CLOCK_REALTIME, &start);
-            epicsThreadSleep(0.5); // Delay 500 ms
-            clock_gettime(CLOCK_REALTIME, &end);
-            time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
-            printf("cpciLLRF::writeInt32: the sleep time is %f nano seconds\n", time_spent);
-
-            setIntegerParam(function, 0);
-            status = uint32Write(fd, offset, 0);
-            if(status != 0) return asynError;
-
-            callParamCallbacks();
-            asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
-                  "%s:%s: status=%d, function=%d, name=%s, offset=%d, value=%d\n",
-                  driverName, functionName, status, function, paramName, offset, value);
-            return asynSuccess;
-        }
-    } else {
-        convertedData = value;
-    }
+    convertedData = paramToReg(reg->conv, value);
     
     regData = convertedData;
-    status = uint32Write(fd, offset, (epicsUInt32) regData);
+    status = uint32Write(fd, reg->offset, (epicsUInt32) regData);
+
+    /* Pulse register, e.g. manual_Clear, the timer writes 0 back and the put returns now.
+     * The timer is never cancelled: cancel waits for a running expiry, which waits for the lock held here */
+    if(reg->pulseWidth > 0 && status == 0) {
+        REG_PULSE *pulse = &regPulses[function - firstRegParam];
+        pulse->armed = (value != 0);
+        if(value != 0) {
+            epicsTimeGetCurrent(&pulse->deadline);
+            epicsTimeAddSeconds(&pulse->deadline, reg->pulseWidth);
+            epicsTimerStartDelay(pulse->timer, reg->pulseWidth);
+        }
+    }
 
     /* Do callbacks so higher layers see any changes */
     callParamCallbacks();
@@ -558,12 +1550,12 @@ asynStatus cpciLLRF::writeInt32(asynUser *pasynUser, epicsInt32 value)
     if(status == 0) {
         asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
                   "%s:%s: status=%d, function=%d, name=%s, offset=%d, value=%d\n",
-                  driverName, functionName, status, function, paramName, offset, value);
+                  driverName, functionName, status, function, reg->name, reg->offset, value);
     }
     else {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
                   "%s:%s: status=%d, function=%d, name=%s, offset=%d, value=%d\n",
-                  driverName, functionName, status, function, paramName, offset, value);
+                  driverName, functionName, status, function, reg->name, reg->offset, value);
     }
         
     return (status == 0) ? asynSuccess : asynError;
@@ -576,68 +1568,27 @@ asynStatus cpciLLRF::readFloat64(asynUser *pasynUser, epicsFloat64 *value)
     int function = pasynUser->reason;
     int status = 0;
     
-    const char *paramName;
-    epicsUInt32 offset;
+    PCI_REG_INFO *reg;
     epicsInt32 regData;
     epicsFloat64 convertedData;
+
+    /* Local parameter of the waveform processing */
+    if(function == _average_alpha) {
+        return getDoubleParam(function, value);
+    }
     
-    /* Fetch the parameter name */
-    getParamName(function, &paramName);
-    
-    /* Fetch the register offset from the register name */
-    offset = regNameToOffset(paramName);
-    if(offset == INVALID_OFFSET) {
+    /* Fetch the register of the parameter */
+    reg = regInfo(function);
+    if(reg == NULL) {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
-                  "%s:%s: function=%d - register %s is not defined",
-                  driverName, functionName, function, paramName);
+                  "%s:%s: function=%d - register is not defined",
+                  driverName, functionName, function);
         return asynError;
     }
     
-    status = uint32Read(fd, offset, (epicsUInt32 *) &regData);
+    status = uint32Read(fd, reg->offset, (epicsUInt32 *) &regData);
     
-    if(strcmp(paramName, "sp_phase") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "beam_phase") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "ad_adj_real") == 0) {
-        convertedData = 1.0 * regData / 4096;
-    } else if (strcmp(paramName, "ad_adj_imag") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "da_adj_real") == 0) {
-        convertedData = 1.0 * regData / 4096;
-    } else if (strcmp(paramName, "da_adj_imag") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "da_adj_real2") == 0) {
-        convertedData = 1.0 * regData / 4096;
-    } else if (strcmp(paramName, "da_adj_imag2") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "Overdrive") == 0) {
-        convertedData = 1.0 * regData / 100000;
-    } else if (strcmp(paramName, "SP_P") == 0) {
-    	double temp;
-    	temp = sqrt(1.0 * regData / 1024 * fwd1_k / rfl1_k);
-        convertedData = (temp + 1) / (temp - 1);
-    } else if (strcmp(paramName, "SP_P_1") == 0) {
-        double temp;
-    	temp = sqrt(1.0 * regData / 1024 * fwd2_k / rfl2_k);
-        convertedData = (temp + 1) / (temp - 1);
-    } else if (strcmp(paramName, "SP_P_2") == 0) {
-        double temp;
-    	temp = sqrt(1.0 * regData / 1024 * fwd3_k / rfl3_k);
-        convertedData = (temp + 1) / (temp - 1);
-    } else if (strcmp(paramName, "SP_P_3") == 0) {
-        double temp;
-    	temp = sqrt(1.0 * regData / 1024 * fwd4_k / rfl4_k);
-        convertedData = (temp + 1) / (temp - 1);
-    } else if (strcmp(paramName, "Ch_VSWR_Hold") == 0) {
-        convertedData = 1.0 * regData * 8192 * (fwd1_k * pow(10, 1.0 * fwd1_b / 10));
-    } else if (strcmp(paramName, "sp_phase_state") == 0) {
-        convertedData = 1.0 * regData / 32768 * 180;
-    } else if (strcmp(paramName, "freq_cal_state") == 0) {
-        convertedData = 1.0 * regData * 480 / pow(2, 32);
-    } else {
-        convertedData = regData;
-    }
+    convertedData = regToParam(reg->conv, regData);
 
     *value = convertedData;
 
@@ -657,60 +1608,38 @@ asynStatus cpciLLRF::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
     int function = pasynUser->reason;
     int status = 0;
     
-    const char *paramName;
-    epicsUInt32 offset;
+    PCI_REG_INFO *reg;
     epicsInt32 regData;
     epicsInt32 convertedData;
-    
-    /* Fetch the parameter name */
-    getParamName(function, &paramName);
 
+    /* Exponential averaging weight of the new frame, the average starts again from the next frame */
+    if(function == _average_alpha) {
+        if(!(value > 0 && value <= 1)) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - invalid averaging alpha %f",
+                      driverName, functionName, function, value);
+            return asynError;
+        }
+        setDoubleParam(function, value);
+        return callParamCallbacks();
+    }
+    
     /* Set the parameter in the parameter library. */
     setDoubleParam(function, value);
     
-    /* Fetch the register offset from the register name */
-    offset = regNameToOffset(paramName);
-    if(offset == INVALID_OFFSET) {
+    /* Fetch the register of the parameter */
+    reg = regInfo(function);
+    if(reg == NULL) {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
-                  "%s:%s: function=%d - register %s is not defined",
-                  driverName, functionName, function, paramName);
+                  "%s:%s: function=%d - register is not defined",
+                  driverName, functionName, function);
         return asynError;
     }
     
-    if(strcmp(paramName, "sp_phase") == 0) {
-        convertedData = 1.0 * value / 180 * 32768;
-    } else if (strcmp(paramName, "beam_phase") == 0) {
-        convertedData = 1.0 * value / 180 * 32768;
-    } else if (strcmp(paramName, "ad_adj_real") == 0) {
-        convertedData = 1.0 * value * 4096;
-    } else if (strcmp(paramName, "ad_adj_imag") == 0) {
-        convertedData = 1.0 * value / 180 * 32768;
-    } else if (strcmp(paramName, "da_adj_real") == 0) {
-        convertedData = 1.0 * value * 4096;
-    } else if (strcmp(paramName, "da_adj_imag") == 0) {
-        convertedData = 1.0 * value / 180 * 32768;
-    } else if (strcmp(paramName, "da_adj_real2") == 0) {
-        convertedData = 1.0 * value * 4096;
-    } else if (strcmp(paramName, "da_adj_imag2") == 0) {
-        convertedData = 1.0 * value / 180 * 32768;
-    } else if (strcmp(paramName, "Overdrive") == 0) {
-        convertedData = 1.0 * value * 100000;
-    } else if (strcmp(paramName, "SP_P") == 0) {
-        convertedData = 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl1_k / fwd1_k * 1024;
-    } else if (strcmp(paramName, "SP_P_1") == 0) {
-        convertedData = 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl2_k / fwd2_k * 1024;
-    } else if (strcmp(paramName, "SP_P_2") == 0) {
-        convertedData = 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl3_k / fwd3_k * 1024;
-    } else if (strcmp(paramName, "SP_P_3") == 0) {
-        convertedData = 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl4_k / fwd4_k * 1024;
-    } else if (strcmp(paramName, "Ch_VSWR_Hold") == 0) {
-        convertedData = 1.0 * value / (fwd1_k * pow(10, 1.0 * fwd1_b / 10)) / 8192;
-    } else {
-        convertedData = value;
-    }
+    convertedData = paramToReg(reg->conv, value);
 
     regData = convertedData;
-    status = uint32Write(fd, offset, (epicsUInt32) regData);
+    status = uint32Write(fd, reg->offset, (epicsUInt32) regData);
 
     /* Do callbacks so higher layers see any changes */
     callParamCallbacks();
@@ -718,28 +1647,136 @@ asynStatus cpciLLRF::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
     if(status == 0) {
         asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
                   "%s:%s: status=%d, function=%d, name=%s, offset=%d, value=%f\n",
-                  driverName, functionName, status, function, paramName, offset, value);
+                  driverName, functionName, status, function, reg->name, reg->offset, value);
     }
     else {
         asynPrint(pasynUser, ASYN_TRACE_ERROR,
                   "%s:%s: status=%d, function=%d, name=%s, offset=%d, value=%f\n",
-                  driverName, functionName, status, function, paramName, offset, value);
+                  driverName, functionName, status, function, reg->name, reg->offset, value);
     }
         
     return (status == 0) ? asynSuccess : asynError;
 }
 
 
-epicsUInt32 cpciLLRF::regNameToOffset(const char *name)
+/* Positions of a probe set, an empty array disables the set, takes effect from the next frame */
+asynStatus cpciLLRF::writeInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements)
 {
-    epicsUInt32 offset = INVALID_OFFSET;
-    for(int i=0; i<regCount; i++) {
-        if(strcmp(name, registers[i].name) == 0) {
-            offset = registers[i].offset;
-            break;
+    const char* functionName = "writeInt32Array";
+    int function = pasynUser->reason;
+
+    for(int i=0; i<PROBE_SET_NUMBER; i++) {
+        if(function != _probe_positions[i]) continue;
+        if(nElements > PROBE_POINT_MAX) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                      "%s:%s: function=%d - %d probe positions, at most %d",
+                      driverName, functionName, function, (int)nElements, PROBE_POINT_MAX);
+            return asynError;
+        }
+        for(size_t p=0; p<nElements; p++) {
+            if(value[p] < 0 || value[p] >= WAVEFORM_POINT) {
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                          "%s:%s: function=%d - invalid probe position %d",
+                          driverName, functionName, function, value[p]);
+                return asynError;
+            }
         }
+        memcpy(probeSets[i].positions, value, nElements * sizeof(epicsInt32));
+        probeSets[i].count = (int)nElements;
+        probeVersion++;
+        return doCallbacksInt32Array(value, nElements, function, 0);
+    }
+
+    asynPrint(pasynUser, ASYN_TRACE_ERROR,
+              "%s:%s: function=%d - not a probe set",
+              driverName, functionName, function);
+    return asynError;
+}
+
+
+/* Register of a parameter by reason, NULL if the parameter is not a register or the register reasons are not consecutive */
+PCI_REG_INFO *cpciLLRF::regInfo(int reason)
+{
+    if(!regParamsValid || reason < firstRegParam || reason >= firstRegParam + regCount) {
+        return NULL;
+    }
+    return &registers[reason - firstRegParam];
+}
+
+
+/* Register value to parameter value */
+double cpciLLRF::regToParam(REG_CONV conv, epicsInt32 regData)
+{
+    double temp;
+
+    switch(conv) {
+        case REG_CONV_FREQ:
+            return 1.0 * regData / pow(2, 32) * 480000000 - 180000000;
+        case REG_CONV_QSET:
+            return 1.0 * regData / 1000;
+        case REG_CONV_POW_TIME:
+            return 1.0 * regData * 20 * pow(2, 16) / pow(10, 9);
+        case REG_CONV_PRT_COUNT:
+            return 1.0 * regData * 6.25 / 1000;
+        case REG_CONV_PHASE:
+            return 1.0 * regData / 32768 * 180;
+        case REG_CONV_ADJ_REAL:
+            return 1.0 * regData / 4096;
+        case REG_CONV_OVERDRIVE:
+            return 1.0 * regData / 100000;
+        case REG_CONV_SP_P:
+            temp = sqrt(1.0 * regData / 1024 * fwd1_k / rfl1_k);
+            return (temp + 1) / (temp - 1);
+        case REG_CONV_SP_P_1:
+            temp = sqrt(1.0 * regData / 1024 * fwd2_k / rfl2_k);
+            return (temp + 1) / (temp - 1);
+        case REG_CONV_SP_P_2:
+            temp = sqrt(1.0 * regData / 1024 * fwd3_k / rfl3_k);
+            return (temp + 1) / (temp - 1);
+        case REG_CONV_SP_P_3:
+            temp = sqrt(1.0 * regData / 1024 * fwd4_k / rfl4_k);
+            return (temp + 1) / (temp - 1);
+        case REG_CONV_VSWR_HOLD:
+            return 1.0 * regData * 8192 * (fwd1_k * pow(10, 1.0 * fwd1_b / 10));
+        case REG_CONV_FREQ_CAL:
+            return 1.0 * regData * 480 / pow(2, 32);
+        default:
+            return regData;
+    }
+}
+
+
+/* Parameter value to register value, the caller truncates it to 32 bits */
+double cpciLLRF::paramToReg(REG_CONV conv, double value)
+{
+    switch(conv) {
+        case REG_CONV_FREQ:
+            return 1.0 * (180000000 + value) / 480000000 * pow(2, 32);
+        case REG_CONV_QSET:
+            return value * 1000;
+        case REG_CONV_POW_TIME:
+            return 1.0 * value * pow(10, 9) / (20 * pow(2, 16));
+        case REG_CONV_PRT_COUNT:
+            return 1.0 * value * 1000 / 6.25;
+        case REG_CONV_PHASE:
+            return 1.0 * value / 180 * 32768;
+        case REG_CONV_ADJ_REAL:
+            return 1.0 * value * 4096;
+        case REG_CONV_OVERDRIVE:
+            return 1.0 * value * 100000;
+        case REG_CONV_SP_P:
+            return 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl1_k / fwd1_k * 1024;
+        case REG_CONV_SP_P_1:
+            return 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl2_k / fwd2_k * 1024;
+        case REG_CONV_SP_P_2:
+            return 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl3_k / fwd3_k * 1024;
+        case REG_CONV_SP_P_3:
+            return 1.0 * pow(1.0 * (value + 1) / (value - 1), 2) * rfl4_k / fwd4_k * 1024;
+        case REG_CONV_VSWR_HOLD:
+            return 1.0 * value / (fwd1_k * pow(10, 1.0 * fwd1_b / 10)) / 8192;
+        default:
+            return value;
     }
-    return offset;
 }
 
 
@@ -749,10 +1786,10 @@ extern "C" {
 
 /** EPICS iocsh callable function to call constructor for the testAsynPortDriver class.
   * \param[in] portName The name of the asyn port driver to be created.
-  * \param[in] maxPoints The maximum  number of points in the volt and time arrays */
-int cpciLLRFConfigure(const char *portName)
+  * \param[in] workerCount The number of threads processing each frame, 0 or 1 processes in the poller thread */
+int cpciLLRFConfigure(const char *portName, int workerCount)
 {
-    new cpciLLRF(portName);
+    new cpciLLRF(portName, workerCount);
     return(asynSuccess);
 }
 
@@ -760,11 +1797,12 @@ int cpciLLRFConfigure(const char *portName)
 /* EPICS iocsh shell commands */
 
 static const iocshArg initArg0 = { "portName", iocshArgString};
-static const iocshArg * const initArgs[] = { &initArg0 };
-static const iocshFuncDef initFuncDef = {"cpciLLRFConfigure", 1, initArgs};
+static const iocshArg initArg1 = { "workerCount", iocshArgInt};
+static const iocshArg * const initArgs[] = { &initArg0, &initArg1 };
+static const iocshFuncDef initFuncDef = {"cpciLLRFConfigure", 2, initArgs};
 static void initCallFunc(const iocshArgBuf *args)
 {
-    cpciLLRFConfigure(args[0].sval);
+    cpciLLRFConfigure(args[0].sval, args[1].ival);
 }
 
 void cpciLLRFRegister(void)
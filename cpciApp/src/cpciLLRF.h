@@ -8,8 +8,17 @@
  * Created November 14, 2022
  */
 
+#include <epicsEvent.h>
+#include <epicsMessageQueue.h>
+#include <epicsTimer.h>
+
 #include "asynPortDriver.h"
 
+extern "C" {
+    #include "cpciDsp.h"
+    #include "cpciFft.h"
+}
+
 
 #define DEVICE_NAME "/dev/pci_llrf"
 #define INVALID_OFFSET 0xFFFFFFFF
@@ -21,146 +30,384 @@
 #define WAVEFORM_DATA_BYTE 2 /* 16 bits for each point */
 #define WAVEFORM_LENGTH    WAVEFORM_NUMBER*WAVEFORM_POINT*WAVEFORM_DATA_BYTE
 
-#define POLLING_PERIOD_IN_SECOND 1.0
+#define WAVEFORM_READY_OFFSET 508 /* Waveform ready flag, set by FPGA and cleared by software */
+
+#define POLLING_PERIOD_IN_SECOND 1.0 /* Polling period, or the event wait timeout with interrupt */
+#define REGISTER_REFRESH_PERIOD_IN_SECOND 1.0 /* Period of the register readback refresh */
+
+#define PI 3.14159265358979323846
+
+#define MAX_WORKER_COUNT 16 /* Maximum number of threads processing one frame */
+
+#define FRAME_COUNT 4 /* Frame buffers in the pipeline, one per stage and one spare */
+
+/* Region of interest of the conversion and the publication */
+#define ROI_MODE_MANUAL     0 /* roi_start and roi_length */
+#define ROI_MODE_FREQ_CAL   1 /* Frequency calculation window, start_cnt to end_cnt */
+
+#define DECIMATION_OFF 1 /* Decimation factor of no decimated waveforms */
+
+#define SPECTRUM_POINT (WAVEFORM_POINT / 2 + 1) /* Bins of the amplitude spectrum of the region of interest */
 
-#define PI 3.14159
+/* Multi-frame averaging of the raw waveforms, one frame in average_count is converted and published */
+#define AVERAGE_OFF       0
+#define AVERAGE_BOXCAR    1 /* Mean of the average_count frames since the last published frame */
+#define AVERAGE_EMA       2 /* Exponential average with average_alpha */
+#define AVERAGE_COUNT_MAX 256 /* Boxcar sums of int16 are exact in float up to 256 frames, then divided */
 
+/* Probe sets, each one publishes the values of all the outputs at its positions as one array */
+#define PROBE_SET_NUMBER 4
+#define PROBE_POINT_MAX  16  /* Positions of a probe set, the values of output i start at i * PROBE_POINT_MAX */
+#define PROBE_WIDTH_MAX  256 /* Points averaged around a position */
+#define PROBE_VALUE_NUMBER (WF_OUTPUT_NUMBER * PROBE_POINT_MAX)
+
+#define STABILITY_WINDOW_MAX 100000 /* Pulses of the longest stability window */
+
+
+/* Unit conversion between the register value and the parameter value */
+typedef enum _REG_CONV
+{
+    REG_CONV_NONE,
+    REG_CONV_FREQ,          /* sp_freq, Hz */
+    REG_CONV_QSET,          /* Qset */
+    REG_CONV_POW_TIME,      /* Power up/down (hold) times, s */
+    REG_CONV_PRT_COUNT,     /* PRT start/end count, us */
+    REG_CONV_PHASE,         /* Phases, degree */
+    REG_CONV_ADJ_REAL,      /* AD/DA adjustment real parts */
+    REG_CONV_OVERDRIVE,     /* Overdrive */
+    REG_CONV_SP_P,          /* VSWR set points of channels 1 to 4 */
+    REG_CONV_SP_P_1,
+    REG_CONV_SP_P_2,
+    REG_CONV_SP_P_3,
+    REG_CONV_VSWR_HOLD,     /* Ch_VSWR_Hold */
+    REG_CONV_FREQ_CAL       /* freq_cal_state, MHz, read only */
+} REG_CONV;
 
 typedef struct _PCI_REG_INFO
 {
     char name[50];
     epicsUInt32 offset;
     asynParamType type;
+    REG_CONV conv;
+    double pulseWidth; /* Seconds a non-zero write holds before the register is reset to 0, 0 if not a pulse register */
 } PCI_REG_INFO;
 
 
+/* Raw waveforms from FPGA, in the order of the waveform block */
+typedef enum _RAW_CHANNEL
+{
+    RAW_CAV2_AMP,     /* Pickup 2 amplitude */
+    RAW_CAV2_PHASE,   /* Pickup 2 phase */
+    RAW_CAV1_AMP,     /* Pickup 1 amplitude */
+    RAW_CAV1_PHASE,   /* Pickup 1 phase */
+    RAW_FWD1_I,       /* Channel 1 forward I */
+    RAW_FWD1_Q,       /* Channel 1 forward Q */
+    RAW_RFL1_I,       /* Channel 1 reverse I */
+    RAW_RFL1_Q,       /* Channel 1 reverse Q */
+    RAW_FWD2_I,       /* Channel 2 forward I */
+    RAW_FWD2_Q,       /* Channel 2 forward Q */
+    RAW_RFL2_I,       /* Channel 2 reverse I */
+    RAW_RFL2_Q,       /* Channel 2 reverse Q */
+    RAW_DAC_AMP,      /* DAC amplitude */
+    RAW_DAC_PHASE     /* DAC phase */
+} RAW_CHANNEL;
+
+/* EPICS waveforms converted from each frame, the parameter names are in cpciLLRF::waveformNames */
+typedef enum _WAVEFORM_OUTPUT
+{
+    WF_CAV2_AMP,
+    WF_CAV2_PHASE,
+    WF_CAV1_AMP,
+    WF_CAV1_PHASE,
+
+    WF_FWD1_AMP,
+    WF_FWD1_PHASE,
+    WF_FWD1_POWER,
+    WF_RFL1_AMP,
+    WF_RFL1_PHASE,
+    WF_RFL1_POWER,
+    WF_CAV_VSWR1,
+
+    WF_FWD2_AMP,
+    WF_FWD2_PHASE,
+    WF_FWD2_POWER,
+    WF_RFL2_AMP,
+    WF_RFL2_PHASE,
+    WF_RFL2_POWER,
+    WF_CAV_VSWR2,
+
+    WF_CAV_INPOWER,
+    WF_CAV_FWDPOWER,
+    WF_CAV_RFLPOWER,
+
+    WF_DAC_AMP,
+    WF_DAC_PHASE,
+
+    WF_OUTPUT_NUMBER
+} WAVEFORM_OUTPUT;
+
+/* Groups of the change detection, the outputs of a group depend only on the raw channels of the group */
+typedef enum _CHANNEL_GROUP
+{
+    GROUP_CAV2,         /* Pickup 2 */
+    GROUP_CAV1,         /* Pickup 1 */
+    GROUP_RF_CHAINS,    /* Both RF chains, the cavity sums need the two */
+    GROUP_DAC,
+    GROUP_NUMBER
+} CHANNEL_GROUP;
+
+#define GROUP_ALL ((1 << GROUP_NUMBER) - 1)
+
+#define CHANNEL_ALL ((1 << WAVEFORM_NUMBER) - 1) /* Readout mask of all the raw channels */
+
+/* Outputs with the pulse-to-pulse stability of the flattop, the parameter names are in cpciLLRF::waveformNames */
+typedef enum _STABILITY_OUTPUT
+{
+    STAB_CAV2_AMP,
+    STAB_CAV2_PHASE,
+    STAB_CAV1_AMP,
+    STAB_CAV1_PHASE,
+    STAB_FWD1_AMP,
+    STAB_FWD1_PHASE,
+    STAB_FWD2_AMP,
+    STAB_FWD2_PHASE,
+    STAB_OUTPUT_NUMBER
+} STABILITY_OUTPUT;
+
+/* Settings a frame is processed with, any change converts and publishes all the groups again */
+typedef struct _PROCESS_SETTINGS
+{
+    int phaseMode;
+    int float32Mask;
+    int roiStart;
+    int roiEnd;
+    int decimationFactor;
+    int position;
+    int outputs;    /* Outputs with interrupt clients */
+    int statsStart;
+    int statsEnd;
+    int spectrumMask;
+    int spectrumWindow;
+    int probeVersion;
+} PROCESS_SETTINGS;
+
+/* Positions of one probe set */
+typedef struct _PROBE_SET
+{
+    int count;      /* Positions used, 0 if the set is not published */
+    int width;      /* Points averaged around each position */
+    int positions[PROBE_POINT_MAX];
+} PROBE_SET;
+
+/* One frame of the pipeline, the raw block from FPGA and the EPICS waveforms converted from it */
+typedef struct _LLRF_FRAME
+{
+    short raw[WAVEFORM_NUMBER*WAVEFORM_POINT]; /* 16 bits for each waveform point */
+    epicsFloat64 output[WF_OUTPUT_NUMBER][WAVEFORM_POINT];
+    epicsFloat32 output32[WF_OUTPUT_NUMBER][WAVEFORM_POINT]; /* Float32 copy of the outputs selected by float32Mask */
+    int float32Mask; /* Bit i set: output i is published as Float32 instead of Float64 */
+    int roiStart;    /* Points [roiStart, roiEnd) are converted and published */
+    int roiEnd;
+    epicsFloat64 decimated[WF_OUTPUT_NUMBER][WAVEFORM_POINT + 1]; /* Min/max of each bucket of the region of interest */
+    int decimationFactor;
+    int decimatedLength;
+    int position;     /* Waveform single point position */
+    int changedMask;  /* Bit g set: group g changed, it is converted and published */
+    int outputMask;   /* Bit i set: output i has interrupt clients and its channels are read, it is converted and published */
+    int channelMask;  /* Bit c set: raw channel c was read from FPGA, the others are stale */
+    int statsStart;   /* Statistics over points [statsStart, statsEnd) of the region of interest */
+    int statsEnd;
+    DSP_STATS stats[WF_OUTPUT_NUMBER];
+    epicsFloat64 spectrum[WF_OUTPUT_NUMBER][SPECTRUM_POINT];
+    int spectrumMask; /* Bit i set: the spectrum of output i is computed and published */
+    int probeCount[PROBE_SET_NUMBER];
+    epicsFloat64 probeValues[PROBE_SET_NUMBER][PROBE_VALUE_NUMBER];
+    DSP_FRAME dsp; /* Conversion of the RF chains, from raw into output */
+} LLRF_FRAME;
+
+#define RAW_WAVEFORM(frame, channel) ((frame)->raw + (channel) * WAVEFORM_POINT)
+
+
+/* Averaging of the raw channels read, owned by the processing thread */
+typedef struct _AVERAGE_STATE
+{
+    int mode;           /* Settings of the average in progress, a change starts it again */
+    int count;
+    double alpha;
+    int channelMask;
+    int frames;         /* Frames since the last averaged frame */
+    bool started;       /* The exponential average holds at least one frame */
+    int *sum;           /* Boxcar sums, WAVEFORM_NUMBER*WAVEFORM_POINT */
+    float *acc;         /* Exponential average, WAVEFORM_NUMBER*WAVEFORM_POINT */
+} AVERAGE_STATE;
+
+
+class cpciLLRF;
+struct _IO_REG_ENTRY;
+
+/* Timer that resets a pulse register, see PCI_REG_INFO.pulseWidth */
+typedef struct _REG_PULSE
+{
+    cpciLLRF *owner;
+    int index; /* Index in cpciLLRF::registers */
+    epicsTimerId timer;
+    bool armed;              /* Set under the lock, the register is reset to 0 at the deadline */
+    epicsTimeStamp deadline;
+} REG_PULSE;
+
+/* Thread of the frame processing pool, it converts the points [start, end) of each frame */
+typedef struct _PROCESS_WORKER
+{
+    cpciLLRF *owner;
+    LLRF_FRAME *frame;
+    epicsEventId startEvent; /* Signaled when the block of a new frame is assigned */
+    epicsEventId doneEvent;  /* Signaled when the block is converted */
+    int start;
+    int end;
+    DSP_STATS stats[WF_OUTPUT_NUMBER]; /* Statistics window points of the block */
+} PROCESS_WORKER;
+
+
 class cpciLLRF: public asynPortDriver {
 public:
-    cpciLLRF(const char *portName);
+    cpciLLRF(const char *portName, int workerCount);
 
     virtual asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
     
     virtual asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value);
     virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
-    
-    epicsUInt32 regNameToOffset(const char *name);
+
+    virtual asynStatus writeInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements);
 
     void pollerThread(void);
+    void processThread(void);
+    void publishThread(void);
+    void workerThread(PROCESS_WORKER *worker);
+    void pulseExpired(REG_PULSE *pulse);
+    int outputsOfReason(int reason);
 
 protected:
     static PCI_REG_INFO registers[];
     static int regCount;
+    int firstRegParam; /* Register parameters are created first, the reason of registers[i] is firstRegParam + i */
+    bool regParamsValid; /* The register reasons are consecutive, otherwise no register is accessed */
+    int startCntReason;
+    int endCntReason;
+    epicsTimerQueueId pulseQueue;
+    REG_PULSE *regPulses; /* Entry i is registers[i], the timer is NULL if it is not a pulse register */
+    struct _IO_REG_ENTRY *regSnapshot; /* Batch read of all the registers, entry i is registers[i] */
+    epicsTimeStamp lastRefresh;
+    epicsTimeStamp lastRead;   /* Last waveform read, the interrupt mode reads at least once per polling period */
+    unsigned int irqTimeouts;  /* Polling periods without waveform ready interrupt */
+    void refreshRegisters(void);
+    PCI_REG_INFO *regInfo(int reason);
+    double regToParam(REG_CONV conv, epicsInt32 regData);
+    double paramToReg(REG_CONV conv, double value);
     int fd;
-
-    /**** Waveform buffer ****/
-    short waveformBuffer[WAVEFORM_NUMBER*WAVEFORM_POINT]; /* 16 bits for each waveform point */
-
-    /**** Waveform raw data from FPGA ****/
-    const short *waveform_0 = waveformBuffer;  // Pickup 2 amplitude
-    const short *waveform_1 = waveformBuffer + WAVEFORM_POINT * 1;  // Pickup 2 phase
-    const short *waveform_2 = waveformBuffer + WAVEFORM_POINT * 2;  // Pickup 1 amplitude
-    const short *waveform_3 = waveformBuffer + WAVEFORM_POINT * 3;  // Pickup 1 phase
-    const short *waveform_4 = waveformBuffer + WAVEFORM_POINT * 4;  // Channel 1 forward I
-    const short *waveform_5 = waveformBuffer + WAVEFORM_POINT * 5;  // Channel 1 forward Q
-    const short *waveform_6 = waveformBuffer + WAVEFORM_POINT * 6;  // Channel 1 reverse I
-    const short *waveform_7 = waveformBuffer + WAVEFORM_POINT * 7;  // Channel 1 reverse Q
-    const short *waveform_8 = waveformBuffer + WAVEFORM_POINT * 8;  // Channel 2 forward I
-    const short *waveform_9 = waveformBuffer + WAVEFORM_POINT * 9;  // Channel 2 forward Q
-    const short *waveform_10 = waveformBuffer + WAVEFORM_POINT * 10;  // Channel 2 reverse I
-    const short *waveform_11 = waveformBuffer + WAVEFORM_POINT * 11;  // Channel 2 reverse Q
-    const short *waveform_12 = waveformBuffer + WAVEFORM_POINT * 12;  // DAC amplitude
-    const short *waveform_13 = waveformBuffer + WAVEFORM_POINT * 13;  // DAC phase
-
-    /**** EPICS waveform data ****/
-    epicsFloat64 waveform_CAV2_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV2_phase[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV1_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV1_phase[WAVEFORM_POINT];
-
-    epicsFloat64 waveform_fwd1_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_fwd1_phase[WAVEFORM_POINT];
-    epicsFloat64 waveform_fwd1_power[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl1_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl1_phase[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl1_power[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV_VSWR1[WAVEFORM_POINT];
-
-    epicsFloat64 waveform_fwd2_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_fwd2_phase[WAVEFORM_POINT];
-    epicsFloat64 waveform_fwd2_power[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl2_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl2_phase[WAVEFORM_POINT];
-    epicsFloat64 waveform_rfl2_power[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV_VSWR2[WAVEFORM_POINT];
-
-    epicsFloat64 waveform_CAV_inpower[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV_fwdpower[WAVEFORM_POINT];
-    epicsFloat64 waveform_CAV_rflpower[WAVEFORM_POINT];
-
-    epicsFloat64 waveform_DAC_amp[WAVEFORM_POINT];
-    epicsFloat64 waveform_DAC_phase[WAVEFORM_POINT];
-
-    /**** asynPortDriver parameters for waveform ****/
-    int _waveform_CAV2_amp;
-    int _waveform_CAV2_phase;
-    int _waveform_CAV1_amp;
-    int _waveform_CAV1_phase;
-
-    int _waveform_fwd1_amp;
-    int _waveform_fwd1_phase;
-    int _waveform_fwd1_power;
-    int _waveform_rfl1_amp;
-    int _waveform_rfl1_phase;
-    int _waveform_rfl1_power;
-    int _waveform_CAV_VSWR1;
-
-    int _waveform_fwd2_amp;
-    int _waveform_fwd2_phase;
-    int _waveform_fwd2_power;
-    int _waveform_rfl2_amp;
-    int _waveform_rfl2_phase;
-    int _waveform_rfl2_power;
-    int _waveform_CAV_VSWR2;
-
-    int _waveform_CAV_inpower;
-    int _waveform_CAV_fwdpower;
-    int _waveform_CAV_rflpower;
-
-    int _waveform_DAC_amp;
-    int _waveform_DAC_phase;
+    bool useDma; /* Waveforms are read by the DMA engine of the driver */
+    bool useIrq; /* Frames are processed on the waveform ready interrupt instead of polling */
+
+    /**** Frame pipeline: acquisition in the poller thread, then processing, then publication ****/
+    LLRF_FRAME *frames[FRAME_COUNT];
+    epicsMessageQueueId freeQueue;    /* Frames available to the acquisition */
+    epicsMessageQueueId processQueue; /* Frames acquired, waiting for processing */
+    epicsMessageQueueId publishQueue; /* Frames processed, waiting for publication */
+    unsigned int droppedFrames;       /* Frames not acquired because no frame buffer was free */
+    static const int rawGroups[WAVEFORM_NUMBER];    /* CHANNEL_GROUP of each RAW_CHANNEL */
+    static const int outputGroups[WF_OUTPUT_NUMBER]; /* CHANNEL_GROUP of each WAVEFORM_OUTPUT */
+    static const int outputChannels[WF_OUTPUT_NUMBER]; /* Raw channels each WAVEFORM_OUTPUT is computed from */
+    unsigned long long rawHashes[WAVEFORM_NUMBER];  /* Raw channels of the previous frame */
+    PROCESS_SETTINGS lastSettings;
+    AVERAGE_STATE average;
+    void initFrame(LLRF_FRAME *frame);
+    bool averageFrame(LLRF_FRAME *frame, int mode, int count, double alpha);
+    int subscribedOutputs(void);
+    bool outputConverted(const LLRF_FRAME *frame, int output)
+    {
+        return (frame->outputMask & (1 << output)) && (frame->changedMask & (1 << outputGroups[output]));
+    }
+
+    /**** Frame processing pool, the processing thread converts the first block itself ****/
+    int workerCount;
+    PROCESS_WORKER workers[MAX_WORKER_COUNT];
+    void processFrame(LLRF_FRAME *frame);
+    void processBlock(LLRF_FRAME *frame, int start, int end, DSP_STATS *stats);
+    FFT_PLAN *fftPlan; /* Used by the processing thread only */
+
+    /**** Probe sets, the positions are set under the lock and the values are computed by the processing thread ****/
+    PROBE_SET probeSets[PROBE_SET_NUMBER];
+    int probeVersion; /* Incremented on each change of the probe sets */
+    epicsFloat64 probeValues[PROBE_SET_NUMBER][PROBE_VALUE_NUMBER]; /* Values of the outputs not converted are kept */
+    void probeFrame(LLRF_FRAME *frame, const PROBE_SET *probes);
+
+    /**** asynPortDriver parameters for waveform, indexed by WAVEFORM_OUTPUT ****/
+    static const char *waveformNames[];
+    int _waveform[WF_OUTPUT_NUMBER];
+
+    /**** asynPortDriver parameters for Float32 publication, bit i of _float32_mask selects WAVEFORM_OUTPUT i ****/
+    int _float32_mask;
+    int _waveform_f32[WF_OUTPUT_NUMBER];
+
+    /**** asynPortDriver parameters for the amplitude spectra, bit i of _spectrum_mask selects WAVEFORM_OUTPUT i ****/
+    int _spectrum_mask;
+    int _spectrum_window;
+    int _spectrum[WF_OUTPUT_NUMBER];
+
+    /**** asynPortDriver parameters for the raw waveforms, indexed by RAW_CHANNEL ****/
+    int _waveform_raw[WAVEFORM_NUMBER];
+
+    /**** asynPortDriver parameters for the min/max decimated waveforms, indexed by WAVEFORM_OUTPUT ****/
+    int _decimation_factor;
+    int _waveform_dec[WF_OUTPUT_NUMBER];
+
+    /**** asynPortDriver parameters for the multi-frame averaging ****/
+    int _average_mode;
+    int _average_count;
+    int _average_alpha;
+
+    /**** asynPortDriver parameter for the readout, bit c enables RAW_CHANNEL c ****/
+    int _channel_mask;
+    int _irq_timeouts;
+    int _dropped_frames;
+
+    /**** asynPortDriver parameters for the window statistics, indexed by WAVEFORM_OUTPUT ****/
+    int _stats_start;
+    int _stats_length;
+    int _stats_min[WF_OUTPUT_NUMBER];
+    int _stats_max[WF_OUTPUT_NUMBER];
+    int _stats_mean[WF_OUTPUT_NUMBER];
+    int _stats_rms[WF_OUTPUT_NUMBER];
+
+    /**** Pulse-to-pulse stability of the statistics window means, updated by the publication thread ****/
+    static const int stabilityOutputs[STAB_OUTPUT_NUMBER]; /* WAVEFORM_OUTPUT of each STABILITY_OUTPUT */
+    DSP_STABILITY stability[STAB_OUTPUT_NUMBER];
+    bool stabilityReset; /* Set under the lock, the next frame starts the statistics again */
+
+    /**** asynPortDriver parameters for the stability, indexed by STABILITY_OUTPUT ****/
+    int _stability_window;
+    int _stability_reset;
+    int _stability_mean[STAB_OUTPUT_NUMBER];
+    int _stability[STAB_OUTPUT_NUMBER]; /* % RMS of an amplitude, degrees RMS of a phase */
+
+    /**** asynPortDriver parameters for the region of interest ****/
+    int _roi_mode;
+    int _roi_start;
+    int _roi_length;
+
+    /**** asynPortDriver parameter for the phase computation, DSP_PHASE_ACCURATE or DSP_PHASE_FAST ****/
+    int _phase_mode;
 
     /**** asynPortDriver parameters for waveform single point position ****/
     int _waveform_single_point_position;
 
-    /**** asynPortDriver parameters for waveform single point value ****/
-    int _waveform_single_point_CAV2_amp;
-    int _waveform_single_point_CAV2_phase;
-    int _waveform_single_point_CAV1_amp;
-    int _waveform_single_point_CAV1_phase;
-
-    int _waveform_single_point_fwd1_amp;
-    int _waveform_single_point_fwd1_phase;
-    int _waveform_single_point_fwd1_power;
-    int _waveform_single_point_rfl1_amp;
-    int _waveform_single_point_rfl1_phase;
-    int _waveform_single_point_rfl1_power;
-    int _waveform_single_point_CAV_VSWR1;
-
-    int _waveform_single_point_fwd2_amp;
-    int _waveform_single_point_fwd2_phase;
-    int _waveform_single_point_fwd2_power;
-    int _waveform_single_point_rfl2_amp;
-    int _waveform_single_point_rfl2_phase;
-    int _waveform_single_point_rfl2_power;
-    int _waveform_single_point_CAV_VSWR2;
-
-    int _waveform_single_point_CAV_inpower;
-    int _waveform_single_point_CAV_fwdpower;
-    int _waveform_single_point_CAV_rflpower;
-
-    int _waveform_single_point_DAC_amp;
-    int _waveform_single_point_DAC_phase;
+    /**** asynPortDriver parameters for the probe sets, indexed by probe set ****/
+    int _probe_positions[PROBE_SET_NUMBER];
+    int _probe_width[PROBE_SET_NUMBER];
+    int _probe_values[PROBE_SET_NUMBER];
+
+    /**** asynPortDriver parameters for waveform single point value, indexed by WAVEFORM_OUTPUT, same as a probe of one position ****/
+    int _waveform_single_point[WF_OUTPUT_NUMBER];
 
 private:
     const double rfl1_k = 0.00000000016526;
@@ -13,10 +13,13 @@ cd "${TOP}"
 dbLoadDatabase "dbd/cpciApp.dbd"
 cpciApp_registerRecordDeviceDriver pdbbase
 
-cpciLLRFConfigure("cpciLLRF")
+## portName, number of threads processing each frame
+cpciLLRFConfigure("cpciLLRF", 2)
 
 ## Load record instances
 dbLoadRecords "db/cpciLLRF.db", "SYS=FACILITY1_ACC_LRF, SUB=LLRF, PORT=cpciLLRF, ADDR=0, TIMEOUT=1"
+## Converted waveforms, an IOC loads only the ones it publishes
+dbLoadTemplate "iocBoot/${IOC}/cpciLLRFOutputs.substitutions", "SYS=FACILITY1_ACC_LRF, SUB=LLRF, PORT=cpciLLRF, ADDR=0, TIMEOUT=1"
 
 ## Set this to see messages from mySub
 #var mySubDebug 1
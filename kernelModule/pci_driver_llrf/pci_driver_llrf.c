@@ -4,7 +4,10 @@
  *                      Linux kernel 5.15.0
  *
  *	      This driver handles single board;
- *        This driver handles only register access, without interrupt or DMA interface.
+ *        This driver handles register access, and waveform read by DMA of the PCI 9056 bridge.
+ *        The waveform ready interrupt of the FPGA is delivered to user space through poll().
+ *        With the module parameter mock=1 the board is emulated in memory, so that the
+ *        interface can be exercised without the hardware.
  *
  * Author: Lin Wang (CSNS)
  * Email:  wanglin@ihep.ac.cn
@@ -22,6 +25,17 @@
 #include <linux/platform_device.h>
 #include <linux/miscdevice.h>
 #include <linux/pci.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+#include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/timer.h>
+#include <linux/spinlock.h>
 
 #include <asm/siginfo.h>
 #include <linux/pid.h>
@@ -94,10 +108,50 @@ typedef struct _PCI_BAR_INFO
 } PCI_BAR_INFO;
 
 
+/* DMA ring, each slot holds one waveform block */
+#define DMA_SLOT_COUNT 4
+#define DMA_SLOT_SIZE  PAGE_ALIGN(WAVEFORM_LENGTH)
+
+
+typedef struct _PCI_DMA_SLOT
+{
+	void *cpuAddr;
+	dma_addr_t busAddr;
+	int state;       // DMA_SLOT_IDLE, DMA_SLOT_BUSY or DMA_SLOT_DONE
+	UINT32 length;   // Length of the last transfer into this slot
+} PCI_DMA_SLOT;
+
+
+typedef struct _PCI_DMA_INFO
+{
+	void __iomem *plxAddr;    // PCI 9056 local configuration registers (BAR 0)
+	UINT32 localBase;         // Local bus address of BAR_INDEX
+	PCI_DMA_SLOT slotList[DMA_SLOT_COUNT];
+	int head;                 // Slot used by the next transfer
+	int busySlot;             // Slot being transferred, -1 if the channel is idle
+} PCI_DMA_INFO;
+
+
+typedef struct _PCI_IRQ_INFO
+{
+	int irq;                         // Linux IRQ number, 0 if interrupts are not used
+	spinlock_t intcsrLock;           // Serializes read-modify-write of PLX_INTCSR
+	atomic_t pending;                // Active bits of PLX_INTCSR latched by the hard handler
+	atomic_t eventCount;             // Waveform ready events
+	atomic_t dmaDone;                // Set when DMA channel 0 raises its done interrupt
+	wait_queue_head_t eventQueue;    // poll() waiters for waveform ready events
+	wait_queue_head_t dmaQueue;      // waitDma() waiter
+	struct timer_list mockTimer;     // Raises the waveform ready events in mock mode
+} PCI_IRQ_INFO;
+
+
 typedef struct _PCI_DEV_INFO
 {
 	PCI_DEV_CSR_INFO pciDevCSRInfo;
 	PCI_BAR_INFO pciBarInfoList[6];
+	char *waveformBuffer;    // Kernel bounce buffer for bulk waveform read
+	PCI_DMA_INFO dmaInfo;
+	PCI_IRQ_INFO irqInfo;
 } PCI_DEV_INFO;
 
 
@@ -110,9 +164,64 @@ typedef struct _PCI_DEV_INFO
 /* For the LLRF board, BAR 2 is used to access registers of the on-board FPGA */
 #define BAR_INDEX 2
 
+/* BAR 0 holds the local configuration registers of the PCI 9056 bridge */
+#define PLX_BAR_INDEX 0
+
+/* PCI 9056 local configuration registers */
+#define PLX_LAS0BA      0x04    /* Local address space 0 local base address */
+#define PLX_DMAMODE0    0x80
+#define PLX_DMAPADR0    0x84    /* PCI address */
+#define PLX_DMALADR0    0x88    /* Local address */
+#define PLX_DMASIZ0     0x8C    /* Transfer size in bytes */
+#define PLX_DMADPR0     0x90    /* Descriptor pointer */
+#define PLX_DMACSR0     0xA8    /* Command/status, 8 bits */
+#define PLX_INTCSR      0x68    /* Interrupt control/status */
+
+#define PLX_DMAMODE_32BIT       0x00000003    /* 32-bit local bus */
+#define PLX_DMAMODE_READY       0x00000040    /* READY# input enable */
+#define PLX_DMAMODE_BURST       0x00000100    /* Local burst enable */
+#define PLX_DMAMODE_DONE_INT    0x00000400    /* Interrupt when the transfer is done */
+#define PLX_DMAMODE_INT_PCI     0x00020000    /* Route the DMA interrupt to PCI INTA# */
+#define PLX_DMADPR_TO_PCI       0x00000008    /* Transfer from local bus to PCI bus */
+#define PLX_DMACSR_ENABLE       0x01
+#define PLX_DMACSR_START        0x02
+#define PLX_DMACSR_ABORT        0x04
+#define PLX_DMACSR_CLEAR_INT    0x08
+#define PLX_DMACSR_DONE         0x10
+
+#define PLX_INTCSR_PCI_INT_ENABLE       0x00000100
+#define PLX_INTCSR_LOCAL_INT_ENABLE     0x00000800    /* LINTi#, driven by the FPGA when waveforms are ready */
+#define PLX_INTCSR_LOCAL_INT_ACTIVE     0x00008000
+#define PLX_INTCSR_DMA0_INT_ENABLE      0x00040000
+#define PLX_INTCSR_DMA0_INT_ACTIVE      0x00200000
+
+#define DMA_SLOT_IDLE 0
+#define DMA_SLOT_BUSY 1
+#define DMA_SLOT_DONE 2
+
+/* Time allowed for one DMA transfer */
+#define DMA_TIMEOUT_MS 100
+
+/* Size of the emulated BAR in mock mode, it covers the registers and the waveform block */
+#define MOCK_BAR_SIZE 0x00080000
+
+/* Period of the emulated waveform ready event */
+#define MOCK_EVENT_PERIOD_MS 1000
+
 /* PCI device information */
 PCI_DEV_INFO *pciDevInfo;
 
+/* Serializes the use of the waveform bounce buffer */
+static DEFINE_MUTEX(waveformMutex);
+
+/* Serializes the DMA channel and the slot states */
+static DEFINE_MUTEX(dmaMutex);
+
+/* Emulate the board in memory instead of probing the PCI device */
+static int mock = 0;
+module_param(mock, int, 0444);
+MODULE_PARM_DESC(mock, "Emulate the LLRF board in memory when set to 1");
+
 /* Meta Information */
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Lin Wang");
@@ -269,54 +378,633 @@ static STATUS mapPciBar(struct pci_dev *dev, PCI_DEV_INFO *localPciDevInfo)
         return ERROR;
     }
 
+	localPciDevInfo->pciBarInfoList[PLX_BAR_INDEX].remapAddr = pci_ioremap_bar(dev, PLX_BAR_INDEX);
+	if(!localPciDevInfo->pciBarInfoList[PLX_BAR_INDEX].remapAddr)
+    {
+        printk("bar %d ioremap error!\n", PLX_BAR_INDEX);
+        iounmap(localPciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr);
+        return ERROR;
+    }
+	localPciDevInfo->dmaInfo.plxAddr = localPciDevInfo->pciBarInfoList[PLX_BAR_INDEX].remapAddr;
+	localPciDevInfo->dmaInfo.localBase = readl(localPciDevInfo->dmaInfo.plxAddr + PLX_LAS0BA) & 0xFFFFFFF0;
+
+	return OK;
+}
+
+
+/**
+ *	Check that a block of the BAR is 32-bit aligned and lies inside the BAR
+ */
+static STATUS checkBarBlock(UINT32 offset, UINT32 length)
+{
+	if(length == 0 || length % 4 != 0 || offset % 4 != 0)
+	{
+		return ERROR;
+	}
+	if(offset > pciDevInfo->pciBarInfoList[BAR_INDEX].rang || length > pciDevInfo->pciBarInfoList[BAR_INDEX].rang + 1 - offset)
+	{
+		return ERROR;
+	}
 	return OK;
 }
 
 
+/**
+ *	Copy a block of the BAR into a kernel buffer using aligned 64-bit and 32-bit MMIO reads
+ */
+static void readBarBlock(char *dest, const char __iomem *src, UINT32 length)
+{
+#ifdef CONFIG_64BIT
+	/* Align the source to 8 bytes, then move the bulk with 64-bit reads */
+	if(!IS_ALIGNED((unsigned long)src, 8) && length >= 4)
+	{
+		*(UINT32 *)dest = readl(src);
+		dest += 4;
+		src += 4;
+		length -= 4;
+	}
+	while(length >= 8)
+	{
+		*(u64 *)dest = readq(src);
+		dest += 8;
+		src += 8;
+		length -= 8;
+	}
+#endif
+	while(length >= 4)
+	{
+		*(UINT32 *)dest = readl(src);
+		dest += 4;
+		src += 4;
+		length -= 4;
+	}
+}
+
+
+/**
+ *	Read a waveform block from the BAR and copy it to user space, chunked by the bounce buffer size
+ */
+static STATUS readWaveformToUser(UINT32 offset, UINT32 length, char __user *buffer)
+{
+	UINT32 chunk;
+	STATUS status = OK;
+
+	if(checkBarBlock(offset, length) != OK)
+	{
+		printk("readWaveformToUser - offset 0x%08X and length %d are not aligned or exceed bar %d!\n", offset, length, BAR_INDEX);
+		return ERROR;
+	}
+
+	mutex_lock(&waveformMutex);
+	while(length > 0)
+	{
+		chunk = min_t(UINT32, length, WAVEFORM_BUFFER_SIZE);
+		readBarBlock(pciDevInfo->waveformBuffer, pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + offset, chunk);
+		if(copy_to_user(buffer, pciDevInfo->waveformBuffer, chunk))
+		{
+			status = ERROR;
+			break;
+		}
+		offset += chunk;
+		buffer += chunk;
+		length -= chunk;
+	}
+	mutex_unlock(&waveformMutex);
+
+	return status;
+}
+
+
+/**
+ *	Execute a batch of register reads or writes in a single kernel entry
+ */
+static STATUS regBatchAccess(IO_REG_BATCH __user *userBatch, int write)
+{
+	IO_REG_BATCH batch;
+	IO_REG_ENTRY *entries;
+	void __iomem *addr;
+	UINT32 i;
+	STATUS status = OK;
+
+	if(copy_from_user(&batch, userBatch, sizeof(IO_REG_BATCH)))
+	{
+		return ERROR;
+	}
+	if(batch.count == 0 || batch.count > REG_BATCH_MAX)
+	{
+		printk("regBatchAccess - invalid count %d!\n", batch.count);
+		return ERROR;
+	}
+
+	entries = kmalloc_array(batch.count, sizeof(IO_REG_ENTRY), GFP_KERNEL);
+	if(!entries)
+	{
+		return ERROR;
+	}
+	if(copy_from_user(entries, batch.entries, batch.count * sizeof(IO_REG_ENTRY)))
+	{
+		kfree(entries);
+		return ERROR;
+	}
+
+	/* Validate the whole batch before touching the hardware */
+	for(i = 0; i < batch.count; i++)
+	{
+		if((entries[i].width != 1 && entries[i].width != 2 && entries[i].width != 4) ||
+		   entries[i].offset % entries[i].width != 0 ||
+		   entries[i].offset > pciDevInfo->pciBarInfoList[BAR_INDEX].rang + 1 - entries[i].width)
+		{
+			printk("regBatchAccess - invalid entry %d: offset 0x%08X width %d!\n", i, entries[i].offset, entries[i].width);
+			kfree(entries);
+			return ERROR;
+		}
+	}
+
+	for(i = 0; i < batch.count; i++)
+	{
+		addr = pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + entries[i].offset;
+		if(write)
+		{
+			switch(entries[i].width)
+			{
+				case 1: REG_WRITE8(addr, entries[i].value); break;
+				case 2: REG_WRITE16(addr, entries[i].value); break;
+				default: REG_WRITE32(addr, entries[i].value); break;
+			}
+		}
+		else
+		{
+			switch(entries[i].width)
+			{
+				case 1: entries[i].value = REG_READ8(addr); break;
+				case 2: entries[i].value = REG_READ16(addr); break;
+				default: entries[i].value = REG_READ32(addr); break;
+			}
+		}
+	}
+
+	if(!write && copy_to_user(batch.entries, entries, batch.count * sizeof(IO_REG_ENTRY)))
+	{
+		status = ERROR;
+	}
+
+	kfree(entries);
+	return status;
+}
+
+
+/**
+ *	Allocate the coherent DMA ring, in mock mode the slots are plain kernel memory
+ */
+static STATUS allocDmaRing(struct pci_dev *dev, PCI_DEV_INFO *localPciDevInfo)
+{
+	int i;
+	PCI_DMA_INFO *dmaInfo = &localPciDevInfo->dmaInfo;
+
+	for(i = 0; i < DMA_SLOT_COUNT; i++)
+	{
+		if(dev)
+		{
+			dmaInfo->slotList[i].cpuAddr = dma_alloc_coherent(&dev->dev, DMA_SLOT_SIZE, &dmaInfo->slotList[i].busAddr, GFP_KERNEL);
+		}
+		else
+		{
+			dmaInfo->slotList[i].cpuAddr = vzalloc(DMA_SLOT_SIZE);
+		}
+		if(!dmaInfo->slotList[i].cpuAddr)
+		{
+			printk("DMA slot %d allocation error!\n", i);
+			return ERROR;
+		}
+		dmaInfo->slotList[i].state = DMA_SLOT_IDLE;
+	}
+	dmaInfo->head = 0;
+	dmaInfo->busySlot = -1;
+
+	return OK;
+}
+
+
+/**
+ *	Free the DMA ring
+ */
+static void freeDmaRing(struct pci_dev *dev, PCI_DEV_INFO *localPciDevInfo)
+{
+	int i;
+	PCI_DMA_INFO *dmaInfo = &localPciDevInfo->dmaInfo;
+
+	for(i = 0; i < DMA_SLOT_COUNT; i++)
+	{
+		if(!dmaInfo->slotList[i].cpuAddr) continue;
+		if(dev)
+		{
+			dma_free_coherent(&dev->dev, DMA_SLOT_SIZE, dmaInfo->slotList[i].cpuAddr, dmaInfo->slotList[i].busAddr);
+		}
+		else
+		{
+			vfree(dmaInfo->slotList[i].cpuAddr);
+		}
+		dmaInfo->slotList[i].cpuAddr = NULL;
+	}
+}
+
+
+/**
+ *	Initialize the event counters and wait queues
+ */
+static void initIrqInfo(PCI_DEV_INFO *localPciDevInfo)
+{
+	PCI_IRQ_INFO *irqInfo = &localPciDevInfo->irqInfo;
+
+	irqInfo->irq = 0;
+	spin_lock_init(&irqInfo->intcsrLock);
+	atomic_set(&irqInfo->pending, 0);
+	atomic_set(&irqInfo->eventCount, 0);
+	atomic_set(&irqInfo->dmaDone, 0);
+	init_waitqueue_head(&irqInfo->eventQueue);
+	init_waitqueue_head(&irqInfo->dmaQueue);
+}
+
+
+/**
+ *	Hard interrupt handler: claim and acknowledge the interrupt of the bridge, the rest is done in irqThread()
+ */
+static irqreturn_t irqHandler(int irq, void *devId)
+{
+	PCI_DEV_INFO *localPciDevInfo = devId;
+	PCI_IRQ_INFO *irqInfo = &localPciDevInfo->irqInfo;
+	void __iomem *plx = localPciDevInfo->dmaInfo.plxAddr;
+	UINT32 intcsr;
+	UINT32 active = 0;
+
+	spin_lock(&irqInfo->intcsrLock);
+	intcsr = readl(plx + PLX_INTCSR);
+	if((intcsr & PLX_INTCSR_LOCAL_INT_ENABLE) && (intcsr & PLX_INTCSR_LOCAL_INT_ACTIVE))
+	{
+		/* LINTi# stays asserted until the ready flag is cleared, keep it masked until RD_EVENT */
+		writel(intcsr & ~PLX_INTCSR_LOCAL_INT_ENABLE, plx + PLX_INTCSR);
+		active |= PLX_INTCSR_LOCAL_INT_ACTIVE;
+	}
+	if(intcsr & PLX_INTCSR_DMA0_INT_ACTIVE)
+	{
+		writeb(PLX_DMACSR_CLEAR_INT, plx + PLX_DMACSR0);
+		active |= PLX_INTCSR_DMA0_INT_ACTIVE;
+	}
+	spin_unlock(&irqInfo->intcsrLock);
+
+	/* The line may be shared with other devices */
+	if(!active)
+	{
+		return IRQ_NONE;
+	}
+
+	atomic_or(active, &irqInfo->pending);
+	return IRQ_WAKE_THREAD;
+}
+
+
+/**
+ *	Threaded interrupt handler: count the event and wake up the waiters
+ */
+static irqreturn_t irqThread(int irq, void *devId)
+{
+	PCI_DEV_INFO *localPciDevInfo = devId;
+	PCI_IRQ_INFO *irqInfo = &localPciDevInfo->irqInfo;
+	UINT32 active = atomic_xchg(&irqInfo->pending, 0);
+
+	if(active & PLX_INTCSR_LOCAL_INT_ACTIVE)
+	{
+		atomic_inc(&irqInfo->eventCount);
+		wake_up_interruptible(&irqInfo->eventQueue);
+	}
+	if(active & PLX_INTCSR_DMA0_INT_ACTIVE)
+	{
+		atomic_set(&irqInfo->dmaDone, 1);
+		wake_up(&irqInfo->dmaQueue);
+	}
+
+	return IRQ_HANDLED;
+}
+
+
+/**
+ *	Request MSI, or the legacy INTA# line, and enable the local and DMA interrupts of the bridge
+ */
+static STATUS setupIrq(struct pci_dev *dev, PCI_DEV_INFO *localPciDevInfo)
+{
+	int ret;
+	int irq;
+	unsigned long flags;
+	PCI_IRQ_INFO *irqInfo = &localPciDevInfo->irqInfo;
+	void __iomem *plx = localPciDevInfo->dmaInfo.plxAddr;
+
+	ret = pci_alloc_irq_vectors(dev, 1, 1, PCI_IRQ_MSI | PCI_IRQ_LEGACY);
+	if(ret < 0)
+	{
+		printk("pci_alloc_irq_vectors() error %d!\n", ret);
+		return ERROR;
+	}
+
+	irq = pci_irq_vector(dev, 0);
+	ret = request_threaded_irq(irq, irqHandler, irqThread, IRQF_SHARED, DEVICE_NAME, localPciDevInfo);
+	if(ret)
+	{
+		printk("request_threaded_irq() error %d for irq %d!\n", ret, irq);
+		pci_free_irq_vectors(dev);
+		return ERROR;
+	}
+	irqInfo->irq = irq;
+
+	spin_lock_irqsave(&irqInfo->intcsrLock, flags);
+	writel(readl(plx + PLX_INTCSR) | PLX_INTCSR_PCI_INT_ENABLE | PLX_INTCSR_LOCAL_INT_ENABLE | PLX_INTCSR_DMA0_INT_ENABLE, plx + PLX_INTCSR);
+	spin_unlock_irqrestore(&irqInfo->intcsrLock, flags);
+
+	printk("Interrupt %d is used for waveform ready and DMA done!\n", irq);
+	return OK;
+}
+
+
+/**
+ *	Disable the interrupts of the bridge and release the IRQ
+ */
+static void freeIrq(struct pci_dev *dev, PCI_DEV_INFO *localPciDevInfo)
+{
+	unsigned long flags;
+	PCI_IRQ_INFO *irqInfo = &localPciDevInfo->irqInfo;
+	void __iomem *plx = localPciDevInfo->dmaInfo.plxAddr;
+
+	if(!irqInfo->irq)
+	{
+		return;
+	}
+
+	spin_lock_irqsave(&irqInfo->intcsrLock, flags);
+	writel(readl(plx + PLX_INTCSR) & ~(PLX_INTCSR_PCI_INT_ENABLE | PLX_INTCSR_LOCAL_INT_ENABLE | PLX_INTCSR_DMA0_INT_ENABLE), plx + PLX_INTCSR);
+	spin_unlock_irqrestore(&irqInfo->intcsrLock, flags);
+
+	free_irq(irqInfo->irq, localPciDevInfo);
+	pci_free_irq_vectors(dev);
+	irqInfo->irq = 0;
+}
+
+
+/**
+ *	Unmask the local interrupt again once user space has acknowledged the event
+ */
+static void armEvent(void)
+{
+	unsigned long flags;
+	PCI_IRQ_INFO *irqInfo = &pciDevInfo->irqInfo;
+	void __iomem *plx = pciDevInfo->dmaInfo.plxAddr;
+
+	if(!irqInfo->irq)
+	{
+		return;
+	}
+
+	spin_lock_irqsave(&irqInfo->intcsrLock, flags);
+	writel(readl(plx + PLX_INTCSR) | PLX_INTCSR_LOCAL_INT_ENABLE, plx + PLX_INTCSR);
+	spin_unlock_irqrestore(&irqInfo->intcsrLock, flags);
+}
+
+
+/**
+ *	Mock mode: raise the ready flag and a waveform ready event periodically, as the FPGA would
+ */
+static void mockEventHandler(struct timer_list *timer)
+{
+	PCI_IRQ_INFO *irqInfo = from_timer(irqInfo, timer, mockTimer);
+
+	REG_WRITE32(pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + WAVEFORM_READY_OFFSET, 1);
+	atomic_inc(&irqInfo->eventCount);
+	wake_up_interruptible(&irqInfo->eventQueue);
+
+	mod_timer(&irqInfo->mockTimer, jiffies + msecs_to_jiffies(MOCK_EVENT_PERIOD_MS));
+}
+
+
+/**
+ *	Program the block mode descriptor of DMA channel 0 for a transfer from the BAR into the next ring slot
+ */
+static STATUS startDma(IO_DMA *ioDma)
+{
+	PCI_DMA_INFO *dmaInfo = &pciDevInfo->dmaInfo;
+	PCI_DMA_SLOT *slot;
+	UINT32 mode;
+
+	if(checkBarBlock(ioDma->offset, ioDma->length) != OK || ioDma->length > DMA_SLOT_SIZE)
+	{
+		printk("startDma - offset 0x%08X and length %d are not aligned or exceed the bar or slot!\n", ioDma->offset, ioDma->length);
+		return ERROR;
+	}
+
+	mutex_lock(&dmaMutex);
+	if(dmaInfo->busySlot >= 0)
+	{
+		mutex_unlock(&dmaMutex);
+		printk("startDma - DMA channel is busy with slot %d!\n", dmaInfo->busySlot);
+		return ERROR;
+	}
+
+	ioDma->slot = dmaInfo->head;
+	dmaInfo->head = (dmaInfo->head + 1) % DMA_SLOT_COUNT;
+	slot = &dmaInfo->slotList[ioDma->slot];
+	slot->length = ioDma->length;
+
+	if(mock)
+	{
+		/* The emulated bus master completes immediately */
+		memcpy(slot->cpuAddr, (void __force *)pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + ioDma->offset, ioDma->length);
+		slot->state = DMA_SLOT_DONE;
+		mutex_unlock(&dmaMutex);
+		return OK;
+	}
+
+	slot->state = DMA_SLOT_BUSY;
+	dmaInfo->busySlot = ioDma->slot;
+
+	mode = PLX_DMAMODE_32BIT | PLX_DMAMODE_READY | PLX_DMAMODE_BURST;
+	if(pciDevInfo->irqInfo.irq)
+	{
+		atomic_set(&pciDevInfo->irqInfo.dmaDone, 0);
+		mode |= PLX_DMAMODE_DONE_INT | PLX_DMAMODE_INT_PCI;
+	}
+	writel(mode, dmaInfo->plxAddr + PLX_DMAMODE0);
+	writel((UINT32)slot->busAddr, dmaInfo->plxAddr + PLX_DMAPADR0);
+	writel(dmaInfo->localBase + ioDma->offset, dmaInfo->plxAddr + PLX_DMALADR0);
+	writel(ioDma->length, dmaInfo->plxAddr + PLX_DMASIZ0);
+	writel(PLX_DMADPR_TO_PCI, dmaInfo->plxAddr + PLX_DMADPR0);
+	writeb(PLX_DMACSR_ENABLE, dmaInfo->plxAddr + PLX_DMACSR0);
+	writeb(PLX_DMACSR_ENABLE | PLX_DMACSR_START, dmaInfo->plxAddr + PLX_DMACSR0);
+	mutex_unlock(&dmaMutex);
+
+	return OK;
+}
+
+
+/**
+ *	Wait for the transfer into a slot to complete and copy the slot to user space
+ */
+static STATUS waitDma(IO_DMA *ioDma)
+{
+	PCI_DMA_INFO *dmaInfo = &pciDevInfo->dmaInfo;
+	PCI_DMA_SLOT *slot;
+	unsigned long timeout;
+	STATUS status = OK;
+
+	if(ioDma->slot >= DMA_SLOT_COUNT)
+	{
+		return ERROR;
+	}
+	slot = &dmaInfo->slotList[ioDma->slot];
+
+	mutex_lock(&dmaMutex);
+	if(slot->state == DMA_SLOT_BUSY && pciDevInfo->irqInfo.irq)
+	{
+		/* The done interrupt is acknowledged by irqHandler() */
+		if(!wait_event_timeout(pciDevInfo->irqInfo.dmaQueue, atomic_read(&pciDevInfo->irqInfo.dmaDone), msecs_to_jiffies(DMA_TIMEOUT_MS)))
+		{
+			printk("waitDma - DMA into slot %d timed out, abort!\n", ioDma->slot);
+			writeb(PLX_DMACSR_ABORT, dmaInfo->plxAddr + PLX_DMACSR0);
+			slot->state = DMA_SLOT_IDLE;
+			dmaInfo->busySlot = -1;
+			mutex_unlock(&dmaMutex);
+			return ERROR;
+		}
+		slot->state = DMA_SLOT_DONE;
+		dmaInfo->busySlot = -1;
+	}
+	else if(slot->state == DMA_SLOT_BUSY)
+	{
+		timeout = jiffies + msecs_to_jiffies(DMA_TIMEOUT_MS);
+		while(!(readb(dmaInfo->plxAddr + PLX_DMACSR0) & PLX_DMACSR_DONE))
+		{
+			if(time_after(jiffies, timeout))
+			{
+				printk("waitDma - DMA into slot %d timed out, abort!\n", ioDma->slot);
+				writeb(PLX_DMACSR_ABORT, dmaInfo->plxAddr + PLX_DMACSR0);
+				slot->state = DMA_SLOT_IDLE;
+				dmaInfo->busySlot = -1;
+				mutex_unlock(&dmaMutex);
+				return ERROR;
+			}
+			usleep_range(20, 50);
+		}
+		writeb(PLX_DMACSR_CLEAR_INT, dmaInfo->plxAddr + PLX_DMACSR0);
+		slot->state = DMA_SLOT_DONE;
+		dmaInfo->busySlot = -1;
+	}
+	if(slot->state != DMA_SLOT_DONE)
+	{
+		mutex_unlock(&dmaMutex);
+		return ERROR;
+	}
+
+	if(copy_to_user(ioDma->buffer, slot->cpuAddr, min_t(UINT32, ioDma->length, slot->length)))
+	{
+		status = ERROR;
+	}
+	mutex_unlock(&dmaMutex);
+
+	return status;
+}
+
+
 /**
  *	File operation: open()
  */
 static int pci_open(struct inode *inode_p, struct file *file_p)
 {
 	printk("pci_driver_llrf - open was called!\n");  
+
+    /* Each file keeps the last event count it has seen, events before open() are not reported */
+    file_p->private_data = (void *)(unsigned long)atomic_read(&pciDevInfo->irqInfo.eventCount);
     return OK;
 }
 
 
 /**
- *	File operation: read()
+ *	File operation: read(), reads the BAR starting at *f_pos
  */
 static ssize_t pci_read(struct file *file_p, char __user *buf, size_t length, loff_t *f_pos)  
 {
-    int ret;
-    printk("pci_driver_llrf - read was called!\n");  
-  
-    ret = copy_to_user(buf, pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + 0, length);
-    if(ret) {
-                printk("pci_read - copy_to_user failed!\n"); 
-            }
+    if(length == 0) {
+        return 0;
+    }
+    if(*f_pos < 0 || checkBarBlock((UINT32)*f_pos, (UINT32)length) != OK) {
+        return -EINVAL;
+    }
+    if(readWaveformToUser((UINT32)*f_pos, (UINT32)length, buf) != OK) {
+        printk("pci_read - readWaveformToUser failed!\n"); 
+        return -EFAULT;
+    }
 
+    *f_pos += length;
     return length;
 }
 
 
 /**
- *	File operation: write()
+ *	File operation: write(), writes the BAR starting at *f_pos with 32-bit MMIO writes
  */
 static ssize_t pci_write(struct file *file_p, const char __user *buf, size_t length, loff_t *f_pos)  
 {    
-    int ret;
-    printk("pci_driver_llrf - write was called!\n");  
+    UINT32 i;
     
-    ret = copy_from_user(pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + 0, buf, length);
-    if(ret) {
-                printk("pci_write - copy_from_user failed!\n"); 
-            }
+    if(length == 0) {
+        return 0;
+    }
+    if(*f_pos < 0 || length > WAVEFORM_BUFFER_SIZE || checkBarBlock((UINT32)*f_pos, (UINT32)length) != OK) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&waveformMutex);
+    if(copy_from_user(pciDevInfo->waveformBuffer, buf, length)) {
+        mutex_unlock(&waveformMutex);
+        printk("pci_write - copy_from_user failed!\n"); 
+        return -EFAULT;
+    }
+    for(i = 0; i < length; i += 4) {
+        writel(*(UINT32 *)(pciDevInfo->waveformBuffer + i), pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + *f_pos + i);
+    }
+    mutex_unlock(&waveformMutex);
       
+    *f_pos += length;
     return length;  
 }
 
 
+/**
+ *	File operation: mmap(), maps the BAR uncached into user space
+ */
+static int pci_mmap(struct file *file_p, struct vm_area_struct *vma)
+{
+    if(mock) {
+        return remap_vmalloc_range(vma, (void __force *)pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr, vma->vm_pgoff);
+    }
+
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+    /* vm_iomap_memory() checks vm_pgoff and the size of the vma against the BAR */
+    return vm_iomap_memory(vma, pciDevInfo->pciBarInfoList[BAR_INDEX].start, pciDevInfo->pciBarInfoList[BAR_INDEX].rang + 1);
+}
+
+
+/**
+ *	File operation: poll(), readable when a waveform ready event has not been consumed by RD_EVENT
+ */
+static __poll_t pci_poll(struct file *file_p, poll_table *wait)
+{
+    PCI_IRQ_INFO *irqInfo = &pciDevInfo->irqInfo;
+
+    poll_wait(file_p, &irqInfo->eventQueue, wait);
+    if((UINT32)atomic_read(&irqInfo->eventCount) != (UINT32)(unsigned long)file_p->private_data) {
+        return EPOLLIN | EPOLLRDNORM;
+    }
+    return 0;
+}
+
+
 /**
  *	File operation: close()
  */ 
@@ -337,6 +1025,13 @@ static long int pci_ioctl(struct file *file, unsigned int cmd, unsigned long arg
 	IO_VALUE * ioValue = &_ioValue;
     IO_WAVEFORM _ioWaveform;
     IO_WAVEFORM * ioWaveform = &_ioWaveform;
+    IO_DEV_INFO _ioDevInfo;
+    IO_DEV_INFO * ioDevInfo = &_ioDevInfo;
+    IO_DMA _ioDma;
+    IO_DMA * ioDma = &_ioDma;
+    IO_EVENT _ioEvent;
+    IO_EVENT * ioEvent = &_ioEvent;
+    UINT32 seen;
     UINT32 offset;
     UINT32 length;
     char *buffer;
@@ -424,6 +1119,64 @@ static long int pci_ioctl(struct file *file, unsigned int cmd, unsigned long arg
             //printk("WR_VALUE_32    addr = 0x%08X    data = 0x%08X\n", ioValue->offset, ioValue->value_32); 
 			break;
 
+        case RD_DEV_INFO:
+            memset(ioDevInfo, 0, sizeof(IO_DEV_INFO));
+            ioDevInfo->barSize = pciDevInfo->pciBarInfoList[BAR_INDEX].rang + 1;
+            ioDevInfo->dmaSlotCount = DMA_SLOT_COUNT;
+            ioDevInfo->dmaSlotSize = DMA_SLOT_SIZE;
+            ioDevInfo->mock = mock;
+            ioDevInfo->irq = (mock || pciDevInfo->irqInfo.irq) ? 1 : 0;
+            ret = copy_to_user((IO_DEV_INFO *) arg, ioDevInfo, sizeof(IO_DEV_INFO));
+            if(ret) {
+                printk("pci_ioctl - RD_DEV_INFO - copy_to_user failed!\n"); 
+                return ERROR;
+            }
+			break;
+
+        case RD_REG_BATCH:
+        case WR_REG_BATCH:
+            ret = regBatchAccess((IO_REG_BATCH __user *)arg, cmd == WR_REG_BATCH);
+            if(ret) {
+                printk("pci_ioctl - %s - regBatchAccess failed!\n", cmd == WR_REG_BATCH ? "WR_REG_BATCH" : "RD_REG_BATCH"); 
+                return ERROR;
+            }
+            //printk("REG_BATCH    cmd = 0x%08X\n", cmd); 
+			break;
+
+        case DMA_START:
+        case DMA_WAIT:
+            ret = copy_from_user(ioDma, (IO_DMA *)arg, sizeof(IO_DMA));
+            if(ret) {
+                printk("pci_ioctl - DMA - copy_from_user failed!\n"); 
+                return ERROR;
+            }
+            ret = (cmd == DMA_START) ? startDma(ioDma) : waitDma(ioDma);
+            if(ret) {
+                return ERROR;
+            }
+            ret = copy_to_user((IO_DMA *) arg, ioDma, sizeof(IO_DMA));
+            if(ret) {
+                printk("pci_ioctl - DMA - copy_to_user failed!\n"); 
+                return ERROR;
+            }
+            //printk("DMA    cmd = 0x%08X    slot = %d\n", cmd, ioDma->slot); 
+			break;
+
+        case RD_EVENT:
+            ioEvent->count = atomic_read(&pciDevInfo->irqInfo.eventCount);
+            seen = (UINT32)(unsigned long)file->private_data;
+            ioEvent->missed = (ioEvent->count - seen > 1) ? ioEvent->count - seen - 1 : 0;
+            file->private_data = (void *)(unsigned long)ioEvent->count;
+            /* The caller has cleared the ready flag, so the next edge of LINTi# can be taken */
+            armEvent();
+            ret = copy_to_user((IO_EVENT *) arg, ioEvent, sizeof(IO_EVENT));
+            if(ret) {
+                printk("pci_ioctl - RD_EVENT - copy_to_user failed!\n"); 
+                return ERROR;
+            }
+            //printk("RD_EVENT    count = %d    missed = %d\n", ioEvent->count, ioEvent->missed); 
+			break;
+
         case RD_WAVEFORM:
             ret = copy_from_user(ioWaveform, (IO_WAVEFORM *)arg, sizeof(IO_WAVEFORM));
             if(ret) {
@@ -435,13 +1188,13 @@ static long int pci_ioctl(struct file *file, unsigned int cmd, unsigned long arg
             buffer = ioWaveform->buffer;
             
             start_time = ktime_get(); /* Time measurement */
-			ret = copy_to_user(buffer, pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + offset, length);
+			ret = readWaveformToUser(offset, length, buffer);
 			stop_time = ktime_get(); /* Time measurement */
 			elapsed_time = ktime_sub(stop_time, start_time);
-            //printk("RD_WAVEFORM - The elapsed time of copy_to_user() is %lld nano seconds\n", ktime_to_ns(elapsed_time));
+            //printk("RD_WAVEFORM - The elapsed time of readWaveformToUser() is %lld nano seconds\n", ktime_to_ns(elapsed_time));
 			
 			if(ret) {
-                printk("pci_ioctl - RD_WAVEFORM - copy_to_user failed!\n"); 
+                printk("pci_ioctl - RD_WAVEFORM - readWaveformToUser failed!\n"); 
                 return ERROR;
             }
             //printk("RD_WAVEFORM    offset = 0x%08X    length = %d\n", offset, length); 
@@ -460,8 +1213,11 @@ static long int pci_ioctl(struct file *file, unsigned int cmd, unsigned long arg
 static struct file_operations pci_fops = {  
     .owner   = THIS_MODULE,  
     .open    = pci_open,
+    .llseek  = default_llseek,
     .read    = pci_read,  
     .write   = pci_write, 
+    .mmap    = pci_mmap,
+    .poll    = pci_poll,
     .release = pci_close,
     .unlocked_ioctl = pci_ioctl,
 };  
@@ -492,14 +1248,15 @@ static int driver_probe(struct pci_dev *dev, const struct pci_device_id *id)
         return ret;
     }
 		
-	pciDevInfo = kmalloc(sizeof(PCI_DEV_INFO), GFP_KERNEL);
+	pciDevInfo = kzalloc(sizeof(PCI_DEV_INFO), GFP_KERNEL);
     if(!pciDevInfo)
     {
-        printk("In %s, kmalloc error!", __func__);
+        printk("In %s, kzalloc error!", __func__);
         pci_release_regions(dev);
         pci_disable_device(dev);
         return ERROR;
     }
+	initIrqInfo(pciDevInfo);
 
     ret = getPciDevCSRInfo(dev, pciDevInfo);
 	if(ret == ERROR)
@@ -528,8 +1285,42 @@ static int driver_probe(struct pci_dev *dev, const struct pci_device_id *id)
         return ERROR;
 	}
 
+	pciDevInfo->waveformBuffer = vmalloc(WAVEFORM_BUFFER_SIZE);
+	if(!pciDevInfo->waveformBuffer)
+	{
+		printk("In %s, vmalloc error!", __func__);
+		kfree(pciDevInfo);
+        pci_release_regions(dev);
+        pci_disable_device(dev);
+        return ERROR;
+	}
+
+	/* The bridge is bus master for DMA, its DMA address registers are 32-bit */
+	pci_set_master(dev);
+	ret = dma_set_mask_and_coherent(&dev->dev, DMA_BIT_MASK(32));
+	if(ret == 0)
+	{
+		ret = allocDmaRing(dev, pciDevInfo);
+	}
+	if(ret)
+	{
+		printk("DMA ring allocation error!\n");
+		freeDmaRing(dev, pciDevInfo);
+		vfree(pciDevInfo->waveformBuffer);
+		kfree(pciDevInfo);
+        pci_release_regions(dev);
+        pci_disable_device(dev);
+        return ERROR;
+	}
+
     printPciDevInfo(pciDevInfo);
 
+	/* Without an interrupt the driver still works, user space falls back to polling */
+	if(setupIrq(dev, pciDevInfo) != OK)
+	{
+		printk("Interrupt is not available, waveform ready events are disabled!\n");
+	}
+
     /**
      *  On success, register_chrdev returns 0 if major is a number other then 0, 
      *  otherwise Linux will choose a major number and return the chosen value.
@@ -537,6 +1328,9 @@ static int driver_probe(struct pci_dev *dev, const struct pci_device_id *id)
     ret = register_chrdev(PCI_MAJOR, DEVICE_NAME, &pci_fops);  
     if(ret < 0)
 	{
+		freeIrq(dev, pciDevInfo);
+		freeDmaRing(dev, pciDevInfo);
+		vfree(pciDevInfo->waveformBuffer);
 		kfree(pciDevInfo);
         pci_release_regions(dev);
         pci_disable_device(dev);
@@ -562,6 +1356,12 @@ static int driver_probe(struct pci_dev *dev, const struct pci_device_id *id)
  */ 
 static void driver_remove(struct pci_dev *dev)
 {
+	if(pciDevInfo != NULL)
+	{
+		freeIrq(dev, pciDevInfo);
+		freeDmaRing(dev, pciDevInfo);
+	}
+	pci_clear_master(dev);
 	pci_release_regions(dev);
 	pci_disable_device(dev);
 	printk("Device is removed successfully!\n");
@@ -579,9 +1379,76 @@ static struct pci_driver pci_driver = {
 };
 
 
+/**
+ *	Mock mode: emulate the board with a BAR in memory holding a test pattern in the waveform block
+ */
+static int mock_probe(void)
+{
+	int ret;
+	int channel, point;
+	short *waveform;
+
+	printk("pci_driver_llrf - mock_probe was called!\n"); 	
+
+	pciDevInfo = kzalloc(sizeof(PCI_DEV_INFO), GFP_KERNEL);
+    if(!pciDevInfo)
+    {
+        printk("In %s, kzalloc error!", __func__);
+        return -ENOMEM;
+    }
+	initIrqInfo(pciDevInfo);
+
+	pciDevInfo->pciBarInfoList[BAR_INDEX].rang = MOCK_BAR_SIZE - 1;
+	pciDevInfo->pciBarInfoList[BAR_INDEX].flag = IORESOURCE_MEM;
+	pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr = (void __iomem __force *)vmalloc_user(MOCK_BAR_SIZE);
+	pciDevInfo->waveformBuffer = vmalloc(WAVEFORM_BUFFER_SIZE);
+	if(!pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr || !pciDevInfo->waveformBuffer || allocDmaRing(NULL, pciDevInfo) != OK)
+	{
+		printk("In %s, allocation error!", __func__);
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	/* Triangle wave test pattern, scaled by channel number */
+	waveform = (void __force *)pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr + WAVEFORM_OFFSET;
+	for(channel = 0; channel < WAVEFORM_NUMBER; channel++)
+	{
+		for(point = 0; point < WAVEFORM_POINT; point++)
+		{
+			waveform[channel * WAVEFORM_POINT + point] = (short)(((point % 512) - 256) * (channel + 1) * 8);
+		}
+	}
+
+    ret = register_chrdev(PCI_MAJOR, DEVICE_NAME, &pci_fops);  
+    if(ret < 0)
+	{
+		goto error;
+	}
+
+	timer_setup(&pciDevInfo->irqInfo.mockTimer, mockEventHandler, 0);
+	mod_timer(&pciDevInfo->irqInfo.mockTimer, jiffies + msecs_to_jiffies(MOCK_EVENT_PERIOD_MS));
+
+    printk("Mock probe succeeds!\n");
+	return OK;
+
+error:
+	freeDmaRing(NULL, pciDevInfo);
+	vfree(pciDevInfo->waveformBuffer);
+	vfree((void __force *)pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr);
+	kfree(pciDevInfo);
+	pciDevInfo = NULL;
+	return ret;
+}
+
+
 static int __init pci_llrf_init(void)
 {
     printk("pci_driver_llrf - pci_llrf_init was called!\n");
+
+    if(mock)
+    {
+        return mock_probe();
+    }
       
     /**
      *  PCI device drivers call pci_register_driver() during their initialization with a pointer to a structure
@@ -594,14 +1461,24 @@ static int __init pci_llrf_init(void)
 static void __exit pci_llrf_exit(void)
 {
     printk("pci_driver_llrf - pci_llrf_exit was called!\n");
-	/* Deletes the driver structure from the list of registered PCI drivers */  
-	pci_unregister_driver(&pci_driver);
+	if(!mock)
+	{
+		/* Deletes the driver structure from the list of registered PCI drivers */  
+		pci_unregister_driver(&pci_driver);
+	}
 	
     /* Unregister and destroy a cdev */
     unregister_chrdev(PCI_MAJOR, DEVICE_NAME);
 
 	if(pciDevInfo != NULL)
 	{
+		if(mock)
+		{
+			del_timer_sync(&pciDevInfo->irqInfo.mockTimer);
+			freeDmaRing(NULL, pciDevInfo);
+			vfree((void __force *)pciDevInfo->pciBarInfoList[BAR_INDEX].remapAddr);
+		}
+		vfree(pciDevInfo->waveformBuffer);
     	kfree(pciDevInfo);
 	}
 }
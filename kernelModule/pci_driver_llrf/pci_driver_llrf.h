@@ -27,6 +27,12 @@ typedef unsigned int UINT32;
 #define WAVEFORM_DATA_BYTE 2 /* 16 bits for each point */
 #define WAVEFORM_LENGTH    WAVEFORM_NUMBER*WAVEFORM_POINT*WAVEFORM_DATA_BYTE
 
+/* Waveform ready flag, set by the FPGA when a new waveform block can be read and cleared by software */
+#define WAVEFORM_READY_OFFSET 508
+
+/* Bounce buffer used by RD_WAVEFORM, larger requests are transferred in chunks of this size */
+#define WAVEFORM_BUFFER_SIZE    (WAVEFORM_LENGTH)
+
 
 /**
  *	Definitions for ioctl()
@@ -46,6 +52,44 @@ typedef struct _IO_WAVEFORM
     char *buffer;
 } IO_WAVEFORM;
 
+typedef struct _IO_DEV_INFO
+{
+    UINT32 barSize;         /* Size of the register BAR, which is also the length accepted by mmap() */
+    UINT32 dmaSlotCount;    /* Number of slots in the DMA ring, 0 if DMA is not supported */
+    UINT32 dmaSlotSize;     /* Maximum length of one DMA transfer */
+    UINT32 mock;            /* 1 if the board is emulated by the driver */
+    UINT32 irq;             /* 1 if waveform ready events are delivered by interrupt, see RD_EVENT */
+} IO_DEV_INFO;
+
+typedef struct _IO_EVENT
+{
+    UINT32 count;     /* Waveform ready events since the driver was loaded */
+    UINT32 missed;    /* Events raised since the last RD_EVENT on this file, minus one */
+} IO_EVENT;
+
+typedef struct _IO_DMA
+{
+    UINT32 offset;    /* DMA_START: BAR offset of the block */
+    UINT32 length;    /* DMA_START: length of the block, DMA_WAIT: size of buffer */
+    UINT32 slot;      /* Returned by DMA_START, passed to DMA_WAIT */
+    char *buffer;     /* DMA_WAIT: the slot is copied here once the transfer completes */
+} IO_DMA;
+
+typedef struct _IO_REG_ENTRY
+{
+    UINT32 offset;
+    UINT32 width;    /* Access width in bytes: 1, 2 or 4 */
+    UINT32 value;
+} IO_REG_ENTRY;
+
+typedef struct _IO_REG_BATCH
+{
+    UINT32 count;    /* Number of entries, at most REG_BATCH_MAX */
+    IO_REG_ENTRY *entries;
+} IO_REG_BATCH;
+
+#define REG_BATCH_MAX 256
+
 
 #define RD_VALUE_8   _IOR('a', 'a', IO_VALUE *)
 #define WR_VALUE_8   _IOW('a', 'b', IO_VALUE *)
@@ -57,3 +101,13 @@ typedef struct _IO_WAVEFORM
 #define WR_VALUE_32  _IOW('a', 'f', IO_VALUE *)
 
 #define RD_WAVEFORM  _IOR('a', 'g', IO_WAVEFORM *)
+
+#define RD_DEV_INFO  _IOR('a', 'h', IO_DEV_INFO *)
+
+#define RD_REG_BATCH _IOR('a', 'i', IO_REG_BATCH *)
+#define WR_REG_BATCH _IOW('a', 'j', IO_REG_BATCH *)
+
+#define DMA_START    _IOWR('a', 'k', IO_DMA *)
+#define DMA_WAIT     _IOWR('a', 'l', IO_DMA *)
+
+#define RD_EVENT     _IOR('a', 'm', IO_EVENT *)
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h> // Time measurement
@@ -30,8 +31,10 @@
 #define CMD_UINT32_REG_READ         9
 #define CMD_UINT32_REG_WRITE        10
 #define CMD_WAVEFORM_READ           11
-#define CMD_EXIT                    12
-#define CMD_NUM                     13
+#define CMD_WAVEFORM_DMA_READ       12
+#define CMD_WAIT_EVENT              13
+#define CMD_EXIT                    14
+#define CMD_NUM                     15
 
 /* Device name */
 #define DEVICE_NAME "/dev/pci_llrf"
@@ -42,7 +45,7 @@
 /* List valid commands */
 const char * cmdList[] = { "help", "mread", "mwrite", "read", "write", \
                            "read8", "write8", "read16", "write16", \
-                           "read32", "write32", "wfread", "exit"};
+                           "read32", "write32", "wfread", "wfdma", "event", "exit"};
 
 /* UINT8 register data read */
 STATUS uint8Read(int fd, UINT32 addr, UINT8 *retData) 
@@ -110,15 +113,65 @@ STATUS uint32Write(int fd, UINT32 addr, UINT32 data)
     return OK;
 }
 
-/* Waveform read, this function copy waveform data byte by byte, the speed is too slow */
-STATUS waveformReadOld(int fd, UINT32 addr, int length, char *buffer) 
+/* Register batch read, one RD_REG_BATCH ioctl per REG_BATCH_MAX entries */
+STATUS regBatchRead(int fd, IO_REG_ENTRY *entries, int count)
+{
+    IO_REG_BATCH batch;
+    for(int i=0; i<count; i+=batch.count) {
+        batch.count = (count - i < REG_BATCH_MAX) ? count - i : REG_BATCH_MAX;
+        batch.entries = entries + i;
+        if(ioctl(fd, RD_REG_BATCH, &batch) != OK) {
+            printf("regBatchRead(): ioctl() RD_REG_BATCH returns ERROR!\n");
+            return ERROR;
+        }
+    }
+    return OK;
+}
+
+/* Waveform read, the whole block is transferred by a single RD_WAVEFORM ioctl */
+STATUS waveformBulkRead(int fd, UINT32 addr, int length, char *buffer) 
 {
     IO_WAVEFORM _ioWaveform;
     IO_WAVEFORM *ioWaveform = &_ioWaveform;
     ioWaveform->offset = addr;
     ioWaveform->length = length;
     ioWaveform->buffer = buffer;
-    ioctl(fd, RD_WAVEFORM, ioWaveform);
+    if(ioctl(fd, RD_WAVEFORM, ioWaveform) != OK) {
+        printf("waveformBulkRead(): ioctl() RD_WAVEFORM returns ERROR!\n");
+        return ERROR;
+    }
+    return OK;
+}
+
+/* Waveform read by the DMA engine, start the transfer and wait for its completion */
+STATUS waveformDmaRead(int fd, UINT32 addr, int length, char *buffer) 
+{
+    IO_DMA ioDma;
+    ioDma.offset = addr;
+    ioDma.length = length;
+    ioDma.buffer = buffer;
+    if(ioctl(fd, DMA_START, &ioDma) != OK || ioctl(fd, DMA_WAIT, &ioDma) != OK) {
+        printf("waveformDmaRead(): ioctl() DMA_START/DMA_WAIT returns ERROR!\n");
+        return ERROR;
+    }
+    return OK;
+}
+
+/* Wait for a waveform ready event, then clear the ready flag and re-arm the interrupt */
+STATUS eventWait(int fd, int timeoutMs, IO_EVENT *event)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if(poll(&pfd, 1, timeoutMs) <= 0) {
+        printf("eventWait(): no event within %d ms!\n", timeoutMs);
+        return ERROR;
+    }
+    if(uint32Write(fd, WAVEFORM_READY_OFFSET, 0) != OK || ioctl(fd, RD_EVENT, event) != OK) {
+        printf("eventWait(): ioctl() RD_EVENT returns ERROR!\n");
+        return ERROR;
+    }
     return OK;
 }
 
@@ -152,7 +205,8 @@ int main(int argc, char* argv[])
     UINT8 retData8;
 	UINT16 retData16;
 	UINT32 retData32;
-	UINT32 retMultipleData[10000];
+	IO_REG_ENTRY retMultipleData[10000];
+	IO_EVENT event;
 
     FILE * fdAllWaveforms;
 	short waveformsBuffer[WAVEFORM_NUMBER*WAVEFORM_POINT]; /* 16 bits for each waveform point */
@@ -229,6 +283,8 @@ int main(int argc, char* argv[])
 				printf("read32   addr                   - read uint32 registers of FPGA\n");
 				printf("write32  addr data              - write uint32 registers of FPGA\n");
 				printf("wfread                          - read all the waveforms from FPGA\n");
+				printf("wfdma                           - read all the waveforms from FPGA by DMA\n");
+				printf("event    [timeout]              - wait for a waveform ready event, timeout in ms\n");
 				printf("exit                            - quit");
 				break;
 
@@ -242,10 +298,22 @@ int main(int argc, char* argv[])
 				}
 				addr = (UINT32)strtoul(arg1, &stopstring, 0);
 				count = (UINT32)strtoul(arg2, &stopstring, 0);
+				if(count == 0 || count > sizeof(retMultipleData) / sizeof(IO_REG_ENTRY))
+				{
+					printf("Command syntax error!");
+					break;
+				}
 				
-				clock_gettime(CLOCK_REALTIME, &start);
 				for(i=0; i<count; i++) {
-					uint32Read(fd, addr + i * 4, &retMultipleData[i]);
+					retMultipleData[i].offset = addr + i * 4;
+					retMultipleData[i].width = 4;
+				}
+				clock_gettime(CLOCK_REALTIME, &start);
+				if(regBatchRead(fd, retMultipleData, count) != OK)
+				{
+					printf("\n");
+					printf("main(): regBatchRead() returns ERROR!\n");
+					break;
 				}
 				clock_gettime(CLOCK_REALTIME, &end);
 				time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
@@ -256,7 +324,7 @@ int main(int argc, char* argv[])
 				for(i=0; i<count; i++) {
 					printf("addr: 0x%08X", addr + i * 4);
 					printf("\t");
-					printf("data: 0x%08X", retMultipleData[i]);
+					printf("data: 0x%08X", retMultipleData[i].value);
 					printf("\n");
 				}
 				break;
@@ -523,7 +591,12 @@ int main(int argc, char* argv[])
 
 			case CMD_WAVEFORM_READ:
 			    clock_gettime(CLOCK_REALTIME, &start);
-				waveformRead(fd, WAVEFORM_OFFSET, WAVEFORM_LENGTH, (char *)waveformsBuffer);
+				if(waveformBulkRead(fd, WAVEFORM_OFFSET, WAVEFORM_LENGTH, (char *)waveformsBuffer) != OK)
+				{
+					printf("\n");
+					printf("main(): waveformBulkRead() returns ERROR!\n");
+					break;
+				}
 				clock_gettime(CLOCK_REALTIME, &end);
 				time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
                 printf("CMD_WAVEFORM_READ: the elapsed time is %f nano seconds\n", time_spent);
@@ -536,6 +609,41 @@ int main(int argc, char* argv[])
 	            fclose(fdAllWaveforms);
 				break;
 				
+			case CMD_WAVEFORM_DMA_READ:
+			    clock_gettime(CLOCK_REALTIME, &start);
+				if(waveformDmaRead(fd, WAVEFORM_OFFSET, WAVEFORM_LENGTH, (char *)waveformsBuffer) != OK)
+				{
+					printf("\n");
+					printf("main(): waveformDmaRead() returns ERROR!\n");
+					break;
+				}
+				clock_gettime(CLOCK_REALTIME, &end);
+				time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
+                printf("CMD_WAVEFORM_DMA_READ: the elapsed time is %f nano seconds\n", time_spent);
+				
+				fdAllWaveforms = fopen("./waveformData.txt","w");
+	            for(int j=0; j<WAVEFORM_POINT; j++)
+	            {
+	                fprintf(fdAllWaveforms,"%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t\n", waveformsBuffer[j], waveformsBuffer[1*4096+j], waveformsBuffer[2*4096+j], waveformsBuffer[3*4096+j], waveformsBuffer[4*4096+j], waveformsBuffer[5*4096+j], waveformsBuffer[6*4096+j], waveformsBuffer[7*4096+j], waveformsBuffer[8*4096+j], waveformsBuffer[9*4096+j], waveformsBuffer[10*4096+j], waveformsBuffer[11*4096+j], waveformsBuffer[12*4096+j], waveformsBuffer[13*4096+j]);
+	            }
+	            fclose(fdAllWaveforms);
+				break;
+				
+			case CMD_WAIT_EVENT:
+				arg1 = strtok(NULL, " ");
+				data = (arg1 == NULL) ? 5000 : strtoul(arg1, &stopstring, 10);
+			    clock_gettime(CLOCK_REALTIME, &start);
+				if(eventWait(fd, data, &event) != OK)
+				{
+					printf("\n");
+					printf("main(): eventWait() returns ERROR!\n");
+					break;
+				}
+				clock_gettime(CLOCK_REALTIME, &end);
+				time_spent = (end.tv_sec - start.tv_sec) * BILLION + (end.tv_nsec - start.tv_nsec);
+                printf("CMD_WAIT_EVENT: event count %d, missed %d, waited %f nano seconds\n", event.count, event.missed, time_spent);
+				break;
+				
 			case CMD_EXIT:
 				printf("Exiting...\n");
 				close(fd);